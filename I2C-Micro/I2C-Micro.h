@@ -15,16 +15,18 @@
 #define I2C_Micro_H
 
 // Pindefinitionen
+// Beim Arduino Micro liegen SDA und SCL auf D2 und D3, der IO-Port
+// beginnt daher erst bei D4 (IO_0 bis IO_7 müssen aufeinander folgen)
 #define IO_RELAY 1
 #define IO_LED 2
-#define IO_0 3
-#define IO_1 4
-#define IO_2 5
-#define IO_3 6
-#define IO_4 7
-#define IO_5 8
-#define IO_6 9
-#define IO_7 10
+#define IO_0 4
+#define IO_1 5
+#define IO_2 6
+#define IO_3 7
+#define IO_4 8
+#define IO_5 9
+#define IO_6 10
+#define IO_7 11
 
 
 
@@ -35,9 +37,172 @@
 #define SCL45 'B'  /*!< SCL 45kHz */
 #define SCL11 'C'  /*!< SCL 11kHz */
 #define SCL1_5 'D' /*!< SCL 1.5kHz */
+#define SCL100 'E' /*!< SCL 100kHz (Standard-Mode), nur I2C-Micro */
+#define SCL400 'F' /*!< SCL 400kHz (Fast-Mode), nur I2C-Micro */
+#define SCL1000 'G' /*!< SCL 1MHz (Fast-Mode Plus), vom ATmega32U4 nicht unterstützt */
+#define TAKT_MAX 400000UL /*!< höchster Takt in Hz, den der ATmega32U4 spezifiziert */
+#define TWBR_MIN 10       /*!< kleinster TWBR-Wert im Master-Betrieb */
 
 #define BAUDRATE 38400
 
+/**
+ * @brief Größe des Empfangs- und Sendepuffers (Zweierpotenz, max. 128)
+ */
+#define RX_GROESSE 128
+#define TX_GROESSE 128
+
+/**
+ * @defgroup UbloxPuffer Puffer für das u-blox-Modul
+ * @{
+ * Der Mikrocontroller fragt das u-blox-Modul im Hintergrund ab ('G')
+ * und sammelt den Datenstrom in einem Ringpuffer, den der Host mit 'F'
+ * in einem Stück abholt.
+ *
+ * Weitere Module werden mit 'g' <Platz> <Adresse> auf den Plätzen 1 bis
+ * #UBLOX_MODULE-1 eingetragen und mit 'f' <Platz> <Anzahl> abgeholt,
+ * Platz 0 ist das Modul von 'G' und 'F'. Die Module werden reihum
+ * abgefragt, jedes hat seinen eigenen Ringpuffer.
+ */
+#define UBLOX_PUFFER 512       /*!< Größe des Ringpuffers (Zweierpotenz) */
+#define UBLOX_MODULE 4         /*!< Anzahl der Plätze für Module */
+#define UBLOX_PUFFER_WEITERE 128 /*!< Größe der Ringpuffer der Plätze 1 bis UBLOX_MODULE-1 (Zweierpotenz) */
+#define UBLOX_INTERVALL 25     /*!< Abstand der Abfragen der Bytezahl in ms */
+#define UBLOX_STUECK 32        /*!< Bytes pro I2C-Lesezugriff (Puffer der Wire-Library) */
+#define UBLOX_REG_ANZAHL 0xFD  /*!< Register mit der Anzahl verfügbarer Bytes (High, Low) */
+#define UBLOX_RAHMEN_MAX 32    /*!< max. Bytes pro 'F' im Protokoll v2 */
+/** @} */
+
+/**
+ * @defgroup Programm Gespeicherte Programme
+ * @{
+ * Ein mit 'M' geladenes Programm aus Busoperationen wird mit 'J' einmalig
+ * oder periodisch ausgeführt, die gelesenen Bytes landen in einem
+ * Ergebnispuffer, den der Host mit 'I' abholt. Jede Operation beginnt
+ * mit einem Befehlsbyte, gefolgt von ihren Parametern.
+ */
+#define PROGRAMM_MAX 128         /*!< max. Länge eines Programms */
+#define PROGRAMM_STUECK 32       /*!< max. Bytes pro Ladebefehl ('M'), höchstens V2_NUTZDATEN_MAX - 2 */
+#define ERGEBNIS_PUFFER 256      /*!< Größe des Ergebnispuffers (Zweierpotenz) */
+#define PROGRAMM_SCHACHTELUNG 4  /*!< max. Tiefe verschachtelter Schleifen */
+#define PROGRAMM_LESEN_MAX 32    /*!< max. Bytes pro Lesezugriff (Puffer der Wire-Library) */
+#define PROGRAMM_SCHREIBEN_MAX 32 /*!< max. Datenbytes pro Schreibzugriff (Puffer der Wire-Library) */
+#define PROGRAMM_EINMAL 0xFF     /*!< 'J': Programm sofort einmal ausführen */
+#define PROGRAMM_TAKT 10         /*!< 'J': Einheit der Periode in ms */
+
+#define PRG_SCHREIBEN 'W'   /*!< 'W' adr n daten...: n Bytes (max. PROGRAMM_SCHREIBEN_MAX) schreiben, dann Stop */
+#define PRG_SCHREIBEN_OS 'w'/*!< 'w' adr n daten...: schreiben ohne Stop (für Restart) */
+#define PRG_LESEN 'R'       /*!< 'R' adr n: n Bytes lesen und ins Ergebnis legen */
+#define PRG_WARTEN 'Z'      /*!< 'Z' ms: warten (blockiert!) */
+#define PRG_SCHLEIFE 'L'    /*!< 'L' n: folgenden Block bis 'E' n-mal ausführen (mind. einmal) */
+#define PRG_SCHLEIFE_ENDE 'E'
+#define PRG_BEI_NACK 'N'    /*!< 'N' k: nach einem NACK k Bytes überspringen */
+#define PRG_MARKE 'M'       /*!< 'M' wert: Byte ins Ergebnis legen */
+#define PRG_STATUS 'S'      /*!< 'S': Status des letzten Zugriffs (0 oder AD0LRB) ins Ergebnis */
+#define PRG_ENDE 'X'        /*!< 'X': Programm beenden */
+/** @} */
+
+/**
+ * @defgroup Welle Wertefolgen am IO-Port
+ * @{
+ * Mit 'w' geladene Werte werden per Timer1-Interrupt im festen Abstand
+ * auf den IO-Port ausgegeben ('Y'). Im Streaming-Betrieb wird jeder Wert
+ * einmal ausgegeben und der Host lädt laufend nach, bei leerem Puffer
+ * bleibt der letzte Wert stehen. Im Wiederholbetrieb läuft der Puffer
+ * endlos im Kreis.
+ */
+#define PORT_PUFFER 256           /*!< Puffer für Wertefolgen und Erfassung (wegen uint8_t-Indizes fest) */
+#define WELLE_MAX 32              /*!< max. Werte pro 'w' */
+#define WELLE_INTERVALL_MIN 20    /*!< kleinster Abstand in µs */
+#define WELLE_STREAMING 0         /*!< 'Y': jeden Wert einmal ausgeben */
+#define WELLE_WIEDERHOLEN 1       /*!< 'Y': Puffer endlos wiederholen */
+/** @} */
+
+/**
+ * @defgroup Erfassung Erfassung am IO-Port
+ * @{
+ * Mit 'd' tastet der Timer1-Interrupt den IO-Port in festem Abstand ab,
+ * auf Wunsch erst ab einem Triggermuster. Die Werte landen im selben
+ * Puffer wie die Wertefolgen (beides gleichzeitig geht nicht) und werden
+ * mit 'z' abgeholt, auch schon während der Erfassung. Läuft der Puffer
+ * über, endet die Erfassung. 'Z' liefert den Zustand.
+ */
+#define ERFASSUNG_WARTET (1 << 0)    /*!< Trigger noch nicht erkannt */
+#define ERFASSUNG_LAEUFT (1 << 1)    /*!< Erfassung läuft */
+#define ERFASSUNG_UEBERLAUF (1 << 2) /*!< Puffer übergelaufen, Erfassung beendet */
+/** @} */
+
+/**
+ * @defgroup Faehigkeiten Fähigkeiten des Adapters
+ * @{
+ * Antwort auf 'Q': 'Q' <Anzahl> gefolgt von
+ *
+ * Byte  | Inhalt
+ * ------|------------------------------------------------------
+ *  0    | Protokollversion
+ *  1-2  | Merkmale (FAEHIG_..., High zuerst)
+ *  3-5  | Baudrate
+ *  6    | unterstützte Taktcodes, Bit i für SCL-Code 'A'+i
+ *  7-8  | Größe des Empfangspuffers
+ *  9-10 | Größe des Sendepuffers
+ * 11-12 | Größe des u-blox-Puffers
+ * 13    | max. Länge eines Programms
+ * 14-15 | Größe des Ergebnispuffers
+ * 16    | max. Zeichen pro HD44780-Befehl
+ * 17    | Fenstergröße im Protokoll v2
+ *
+ * Das ursprüngliche USB-ITS-Gerät kennt 'Q' nicht.
+ */
+#define PROTOKOLL_VERSION 2
+#define FAEHIG_V2 (1 << 0)       /*!< Protokoll v2 */
+#define FAEHIG_HD44780 (1 << 1)  /*!< HD44780-Befehle im Adapter ('H') */
+#define FAEHIG_UBLOX (1 << 2)    /*!< u-blox-Abfrage im Hintergrund ('G', 'F') */
+#define FAEHIG_TAKT (1 << 3)     /*!< beliebiger Takt ('K') */
+#define FAEHIG_PROGRAMM (1 << 4) /*!< gespeicherte Programme ('M', 'J', 'I') */
+#define FAEHIG_WELLE (1 << 5)    /*!< Ausgabe von Wertefolgen am IO-Port ('w', 'Y') */
+#define FAEHIG_ERFASSUNG (1 << 6)/*!< Erfassung am IO-Port ('d', 'z', 'Z') */
+#define FAEHIG_UBLOX_MEHR (1 << 7)/*!< mehrere u-blox-Module im Hintergrund ('g', 'f') */
+#define FAEHIGKEITEN_LAENGE 18
+/** @} */
+
+/**
+ * @brief Längste Antwort auf einen einzelnen Befehl ('F' im Protokoll v2)
+ */
+#define ANTWORT_MAX (2 + UBLOX_RAHMEN_MAX)
+
+/**
+ * @defgroup ProtokollV2 Protokoll v2
+ * @{
+ * Gerahmte Befehle mit Sequenznummer und CRC. Jeder Rahmen ist
+ * aufgebaut als
+ *
+ *     V2_START | Sequenznummer | Länge | Nutzdaten | CRC (High, Low)
+ *
+ * Die Nutzdaten sind ein Befehl bzw. eine Antwort des ursprünglichen
+ * Protokolls, die CRC (CRC-16/CCITT, Startwert 0xFFFF) läuft über
+ * Sequenznummer, Länge und Nutzdaten. Ist in der Länge #V2_NAK gesetzt,
+ * fordert der Mikrocontroller die Wiederholung des Befehls mit der
+ * angegebenen Sequenznummer an.
+ *
+ * Das Startbyte ist kein gültiger Befehl, beide Protokolle können also
+ * parallel verwendet werden.
+ */
+#define V2_START 0xA5                      /*!< Startbyte eines Rahmens */
+#define V2_NAK 0x80                        /*!< Wiederholungsanforderung */
+#define V2_KOPF 5                          /*!< Startbyte, Sequenznummer, Länge und CRC */
+#define V2_FENSTER 4                       /*!< max. Anzahl unbeantworteter Befehle */
+#define V2_NUTZDATEN_MAX (4 + HD44780_MAX) /*!< längster Befehl ('H') */
+/** @} */
+
+/**
+ * @brief Maximale Anzahl an Zeichen pro HD44780-Befehl ('H')
+ * @see hd44780Senden
+ */
+#define HD44780_MAX 32
+
+// Bits des PCF8574 am HD44780-Display
+#define HD44780_EN 0x04  /*!< Enable-Bit */
+#define HD44780_RS 0x01  /*!< Register-Select-Bit */
+
 /**
  * @defgroup Busstatus Busstatus-Rückgabewert für I2C-Befehle
  * @{
@@ -18,14 +18,959 @@
 #include "I2C-Micro.h"
 //#include "i2cmaster.h"
 
-char message[3] = { 0, 0, 0 };
+/**
+ * Empfangs- und Sendepuffer als Ringpuffer. Die Indizes laufen frei
+ * über, die Puffergrößen müssen daher Zweierpotenzen sein.
+ */
+uint8_t rxPuffer[RX_GROESSE];
+uint8_t rxKopf = 0; // nächste Schreibposition
+uint8_t rxEnde = 0; // nächste Leseposition
+
+uint8_t txPuffer[TX_GROESSE];
+uint8_t txKopf = 0;
+uint8_t txEnde = 0;
+
+/**
+ * Fenster des Protokolls v2. Jeder Eintrag enthält zuerst den
+ * empfangenen Befehl und nach der Ausführung die Antwort, die für eine
+ * Wiederholung aufbewahrt wird.
+ */
+#define V2_LEER 0
+#define V2_WARTET 1
+#define V2_ERLEDIGT 2
+
+struct V2Eintrag {
+  uint8_t seq;
+  uint8_t zustand;
+  uint8_t laenge;
+  uint8_t daten[V2_NUTZDATEN_MAX];
+};
+
+V2Eintrag v2Fenster[V2_FENSTER];
+uint8_t v2Erwartet = 0;        // Sequenznummer des nächsten auszuführenden Befehls
+uint8_t v2Angefordert = 0xFF;  // zuletzt per NAK angeforderte Sequenznummer
+V2Eintrag* v2Ziel = NULL;      // Antwort in diesen Eintrag statt in den Sendepuffer
+bool v2Modus = false;          // seit dem letzten Reset kam ein gültiger Rahmen
+
+/**
+ * Ringpuffer für den Datenstrom der u-blox-Module.
+ * @see UbloxPuffer
+ */
+uint8_t ubloxPuffer[UBLOX_PUFFER];
+uint8_t ubloxPufferWeitere[UBLOX_MODULE - 1][UBLOX_PUFFER_WEITERE];
+
+/**
+ * Abfrage eines u-blox-Moduls im Hintergrund, Platz 0 gehört zu 'G' und 'F'.
+ */
+struct UbloxModul {
+  uint8_t* puffer;
+  uint16_t groesse;
+  uint16_t kopf;
+  uint16_t ende;
+  uint8_t adresse;               // 0: keine Abfrage im Hintergrund
+  uint16_t ausstehend;           // laut 0xFD/0xFE noch im Modul
+  unsigned long letzteAbfrage;
+};
+UbloxModul ubloxModule[UBLOX_MODULE];
+uint8_t ubloxNaechstes = 0;      // als nächstes abgefragter Platz
+
+/**
+ * Gespeichertes Programm und Ergebnispuffer
+ * @see Programm
+ */
+uint8_t programm[PROGRAMM_MAX];
+uint8_t programmLaenge = 0;
+uint8_t programmPeriode = 0;        // in PROGRAMM_TAKT ms, 0: nicht periodisch
+unsigned long programmLetzterLauf = 0;
+uint8_t ergebnisPuffer[ERGEBNIS_PUFFER];
+uint16_t ergebnisKopf = 0;
+uint16_t ergebnisEnde = 0;
+
+/**
+ * IO-Port: Register und Bitmasken der Pins IO_0 bis IO_7, damit der
+ * Timer-Interrupt ohne digitalWrite auskommt
+ */
+volatile uint8_t* ioRegister[8];
+volatile uint8_t* ioEingang[8];
+uint8_t ioMaske[8];
+bool ioAusgang = false;
+
+/**
+ * Puffer für Wertefolgen bzw. erfasste Werte, wird im Interrupt gelesen
+ * oder geschrieben. portModus ist WELLE_STREAMING, WELLE_WIEDERHOLEN
+ * oder einer der folgenden Werte.
+ * @see Welle
+ * @see Erfassung
+ */
+#define ERFASSUNG_TRIGGER 2 // auf das Triggermuster warten
+#define ERFASSUNG_AKTIV 3
+
+volatile uint8_t portPuffer[PORT_PUFFER];
+volatile uint8_t portKopf = 0;
+volatile uint8_t portEnde = 0;
+volatile uint8_t portIndex = 0;     // Lesezeiger im Wiederholbetrieb
+volatile uint8_t portModus = WELLE_STREAMING;
+uint8_t triggerMaske = 0;
+uint8_t triggerWert = 0;
+volatile uint16_t erfassungRest = 0;  // noch zu erfassende Werte
+volatile uint8_t erfassungZustand = 0;
+
+/**
+ * Der Host hat mit 'T', 'U', 'S', 's', 'V' oder 'v' eine Übertragung
+ * begonnen, die noch nicht mit 'O' beendet ist. Solange dürfen Abfragen
+ * im Hintergrund den Bus (und die Puffer der Wire-Library) nicht benutzen.
+ */
+bool transaktionOffen = false;
+
+void bearbeiteBefehl(uint8_t* message, uint8_t laenge);
 
 
 uint8_t deviceStatus = 0;
+uint32_t i2cTakt = 100000; // tatsächlicher SCL-Takt in Hz, Voreinstellung der Wire-Library
 
 int slaveAdress = 0;
 
 
+/**
+ * @brief Ein Zeichen oder einen Befehl an ein HD44780-Display senden
+ *
+ * Das Byte wird in zwei Nibbles aufgeteilt, die jeweils mit einem
+ * Enable-Puls an den PCF8574 geschrieben werden. Alle sechs Expanderbytes
+ * gehen in einer I2C-Transaktion raus, der Enable-Puls ist dabei durch
+ * die Übertragungsdauer eines Bytes lang genug.
+ *
+ * @param adr I2C-Adresse des PCF8574
+ * @param modus unteres Nibble des Expanderbytes (Rs und Hintergrundbeleuchtung)
+ * @param wert zu sendendes Zeichen bzw. Befehl
+ * @return Rückgabewert von Wire.endTransmission (0 bei Erfolg)
+ */
+uint8_t hd44780Senden(uint8_t adr, uint8_t modus, uint8_t wert) {
+  uint8_t nibble[2] = { (uint8_t) (wert & 0xF0), (uint8_t) ((wert << 4) & 0xF0) };
+  uint8_t fehler;
+
+  modus &= ~HD44780_EN;
+
+  Wire.beginTransmission(adr);
+  for(uint8_t i = 0; i < 2; i++) {
+    Wire.write(nibble[i] | modus);
+    Wire.write(nibble[i] | modus | HD44780_EN);  // En high
+    Wire.write(nibble[i] | modus);               // En low
+  }
+  fehler = Wire.endTransmission();
+
+  // Clear und Home brauchen deutlich länger als alle anderen Befehle
+  if(!(modus & HD44780_RS) && wert <= 0x03) {
+    delayMicroseconds(2000);
+  } else {
+    delayMicroseconds(50);
+  }
+
+  return fehler;
+}
+
+/**
+ * @brief Anzahl der empfangenen, noch nicht bearbeiteten Bytes
+ */
+inline uint8_t rxBelegt() {
+  return (uint8_t) (rxKopf - rxEnde);
+}
+
+/**
+ * @brief Byte an Position pos hinter dem Anfang des Empfangspuffers lesen,
+ * ohne es zu entfernen
+ */
+inline uint8_t rxLesen(uint8_t pos) {
+  return rxPuffer[(uint8_t) (rxEnde + pos) & (RX_GROESSE - 1)];
+}
+
+/**
+ * @brief Anzahl der freien Bytes im Sendepuffer
+ */
+inline uint8_t txFrei() {
+  return TX_GROESSE - (uint8_t) (txKopf - txEnde);
+}
+
+/**
+ * @brief Bytes unverändert in den Sendepuffer legen
+ */
+void txSchreiben(const uint8_t* daten, uint8_t laenge) {
+  for(uint8_t i = 0; i < laenge && txFrei() > 0; i++) {
+    txPuffer[txKopf++ & (TX_GROESSE - 1)] = daten[i];
+  }
+}
+
+/**
+ * @brief Antwort auf den gerade bearbeiteten Befehl ablegen
+ *
+ * Im ursprünglichen Protokoll geht die Antwort direkt in den
+ * Sendepuffer, bei Protokoll v2 in den Fenstereintrag des Befehls.
+ * Vor der Bearbeitung eines Befehls wird sichergestellt, dass
+ * #ANTWORT_MAX Bytes frei sind, die Antwort passt also immer.
+ *
+ * @param daten Antwort
+ * @param laenge Länge der Antwort
+ */
+void antworten(const uint8_t* daten, uint8_t laenge) {
+  if(v2Ziel == NULL) {
+    txSchreiben(daten, laenge);
+    return;
+  }
+
+  for(uint8_t i = 0; i < laenge && v2Ziel->laenge < V2_NUTZDATEN_MAX; i++) {
+    v2Ziel->daten[v2Ziel->laenge++] = daten[i];
+  }
+}
+
+/**
+ * @brief Länge eines Befehls anhand der ersten beiden Bytes bestimmen
+ *
+ * Die meisten Befehle sind zwei Byte lang, der HD44780-Befehl ('H') hat
+ * eine variable Länge, die erst nach dem zweiten Byte bekannt ist.
+ *
+ * @param befehl erstes Byte (Befehl)
+ * @param parameter zweites Byte
+ * @return Länge des Befehls, 0 falls das erste Byte kein gültiger
+ *         Befehl ist
+ */
+uint8_t befehlsLaenge(uint8_t befehl, uint8_t parameter) {
+  switch(befehl) {
+    case 'H':
+      if(parameter == 0) {
+        return 2;
+      }
+      if(parameter > HD44780_MAX) {
+        return 0;
+      }
+      return 4 + parameter;
+
+    case 'T': case 'U': case 'S': case 's': case 'V': case 'v':
+    case 'O': case 'N': case 'R': case 'C': case 'A': case 'B':
+    case 'W': case 'D': case 'L': case 'P': case 'X': case 'E':
+    case 'G': case 'F': case 'J': case 'I': case 'Q': case 'z': case 'Z':
+      return 2;
+
+    case 'M':
+      if(parameter > PROGRAMM_STUECK) {
+        return 0;
+      }
+      return 2 + parameter;
+
+    case 'g': case 'f':
+      return 3;
+
+    case 'K': case 'Y':
+      return 4;
+
+    case 'd':
+      return 7;
+
+    case 'w':
+      if(parameter > WELLE_MAX) {
+        return 0;
+      }
+      return 2 + parameter;
+
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief CRC-16/CCITT um ein Byte weiterrechnen
+ */
+uint16_t crc16(uint16_t crc, uint8_t byte) {
+  crc ^= (uint16_t) byte << 8;
+  for(uint8_t i = 0; i < 8; i++) {
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+/**
+ * @brief Rahmen des Protokolls v2 in den Sendepuffer legen
+ * @param seq Sequenznummer
+ * @param laenge Länge der Nutzdaten, oder #V2_NAK
+ * @param daten Nutzdaten
+ */
+void v2Senden(uint8_t seq, uint8_t laenge, const uint8_t* daten) {
+  uint8_t kopf[3] = { V2_START, seq, laenge };
+  uint16_t crc = crc16(crc16(0xFFFF, seq), laenge);
+
+  if(laenge == V2_NAK) {
+    laenge = 0;
+  }
+  for(uint8_t i = 0; i < laenge; i++) {
+    crc = crc16(crc, daten[i]);
+  }
+
+  uint8_t pruefsumme[2] = { highByte(crc), lowByte(crc) };
+  txSchreiben(kopf, 3);
+  txSchreiben(daten, laenge);
+  txSchreiben(pruefsumme, 2);
+}
+
+/**
+ * @brief Protokoll v2 auf den Anfangszustand zurücksetzen
+ *
+ * Wird beim Reset ('XX') aufgerufen, damit der Host wieder mit der
+ * Sequenznummer 0 beginnen kann.
+ */
+void v2Zuruecksetzen() {
+  for(uint8_t i = 0; i < V2_FENSTER; i++) {
+    v2Fenster[i].zustand = V2_LEER;
+  }
+  v2Erwartet = 0;
+  v2Angefordert = v2Erwartet - 1;
+  v2Modus = false;
+}
+
+/**
+ * @brief Rahmen des Protokolls v2 am Anfang des Empfangspuffers auswerten
+ *
+ * Befehle werden nur in der Reihenfolge der Sequenznummern ausgeführt.
+ * Ein Befehl, der vor einem fehlenden ankommt, wird im Fenster
+ * zwischengespeichert und der fehlende per NAK angefordert. Wiederholt
+ * der Host einen bereits ausgeführten Befehl, weil die Antwort verloren
+ * ging, wird nur die gespeicherte Antwort erneut gesendet.
+ * Rahmen mit falscher CRC werden verworfen.
+ *
+ * Nach dem ersten gültigen Rahmen werden alle Bytes außerhalb von
+ * Rahmen verworfen statt als Befehle des ursprünglichen Protokolls
+ * ausgeführt, damit Reste beschädigter Rahmen keine Befehle auslösen.
+ * Nur ein ungerahmtes 'XX' schaltet zurück.
+ *
+ * @return false, falls der Rahmen noch nicht vollständig empfangen wurde
+ */
+bool v2Empfangen() {
+  if(rxBelegt() < 3) {
+    return false;
+  }
+
+  uint8_t seq = rxLesen(1);
+  uint8_t laenge = rxLesen(2);
+
+  if(laenge > V2_NUTZDATEN_MAX) {
+    rxEnde++; // kein gültiger Rahmen, Startbyte verwerfen
+    return true;
+  }
+
+  if(rxBelegt() < V2_KOPF + laenge) {
+    return false;
+  }
+
+  uint16_t crc = 0xFFFF;
+  for(uint8_t i = 1; i < 3 + laenge; i++) {
+    crc = crc16(crc, rxLesen(i));
+  }
+  if(crc != (((uint16_t) rxLesen(3 + laenge) << 8) | rxLesen(4 + laenge))) {
+    rxEnde++; // beschädigt, der Host wiederholt den Befehl
+    return true;
+  }
+
+  v2Modus = true;
+
+  V2Eintrag* e = &v2Fenster[seq % V2_FENSTER];
+  uint8_t abstand = seq - v2Erwartet;
+
+  if(abstand < V2_FENSTER) {
+    // neuer Befehl, eventuell vor einem fehlenden
+    e->seq = seq;
+    e->zustand = V2_WARTET;
+    e->laenge = laenge;
+    for(uint8_t i = 0; i < laenge; i++) {
+      e->daten[i] = rxLesen(3 + i);
+    }
+    // nur anfordern, wenn der erwartete Befehl wirklich fehlt und nicht
+    // bloß im selben Durchlauf noch nicht ausgeführt wurde
+    V2Eintrag* naechster = &v2Fenster[v2Erwartet % V2_FENSTER];
+    bool fehlt = naechster->zustand != V2_WARTET || naechster->seq != v2Erwartet;
+    if(abstand != 0 && fehlt && v2Angefordert != v2Erwartet) {
+      v2Angefordert = v2Erwartet;
+      v2Senden(v2Erwartet, V2_NAK, NULL);
+    }
+  } else if((uint8_t) (v2Erwartet - seq) <= V2_FENSTER
+            && e->seq == seq && e->zustand == V2_ERLEDIGT) {
+    // bereits ausgeführt, nur die Antwort ging verloren
+    v2Senden(seq, e->laenge, e->daten);
+  }
+
+  rxEnde += V2_KOPF + laenge;
+  return true;
+}
+
+/**
+ * @brief Zwischengespeicherte Befehle des Protokolls v2 der Reihe nach
+ * ausführen
+ */
+void v2Ausfuehren() {
+  V2Eintrag* e = &v2Fenster[v2Erwartet % V2_FENSTER];
+  uint8_t befehl[V2_NUTZDATEN_MAX];
+  uint8_t laenge;
+
+  while(e->zustand == V2_WARTET && e->seq == v2Erwartet
+        && txFrei() >= ANTWORT_MAX + V2_KOPF) {
+    laenge = e->laenge;
+    memcpy(befehl, e->daten, laenge);
+
+    // Antwort landet im selben Eintrag, ungültige Befehle bekommen
+    // eine leere Antwort
+    e->laenge = 0;
+    v2Ziel = e;
+    if(laenge >= 2 && befehlsLaenge(befehl[0], befehl[1]) == laenge) {
+      bearbeiteBefehl(befehl, laenge);
+    }
+    v2Ziel = NULL;
+
+    e->zustand = V2_ERLEDIGT;
+    v2Senden(e->seq, e->laenge, e->daten);
+
+    v2Erwartet++;
+    v2Angefordert = v2Erwartet - 1; // keine Anforderung mehr offen
+    e = &v2Fenster[v2Erwartet % V2_FENSTER];
+  }
+}
+
+/**
+ * @brief Anzahl der Bytes im Puffer eines u-blox-Moduls
+ */
+inline uint16_t ubloxBelegt(const UbloxModul* m) {
+  return m->kopf - m->ende;
+}
+
+/**
+ * @brief Plätze der u-blox-Module ihren Puffern zuordnen und leeren
+ */
+void ubloxZuruecksetzen() {
+  for(uint8_t i = 0; i < UBLOX_MODULE; i++) {
+    UbloxModul* m = &ubloxModule[i];
+    m->puffer = (i == 0) ? ubloxPuffer : ubloxPufferWeitere[i - 1];
+    m->groesse = (i == 0) ? UBLOX_PUFFER : UBLOX_PUFFER_WEITERE;
+    m->kopf = 0;
+    m->ende = 0;
+    m->adresse = 0;
+    m->ausstehend = 0;
+    m->letzteAbfrage = 0;
+  }
+}
+
+/**
+ * @brief Ein u-blox-Modul im Hintergrund abfragen
+ *
+ * Alle #UBLOX_INTERVALL ms wird die Anzahl verfügbarer Bytes aus den
+ * Registern 0xFD/0xFE gelesen. Danach steht der Registerzeiger auf 0xFF,
+ * sodass die Daten ohne erneutes Schreiben der Registeradresse gelesen
+ * werden können, pro Aufruf höchstens #UBLOX_STUECK Bytes, damit die
+ * Befehle des Hosts nicht lange warten. Ist der Puffer voll, wird nicht
+ * weitergelesen, die Daten bleiben dann im Modul.
+ */
+void ubloxModulAbfragen(UbloxModul* m) {
+  if(m->ausstehend == 0) {
+    if(millis() - m->letzteAbfrage < UBLOX_INTERVALL) {
+      return;
+    }
+    m->letzteAbfrage = millis();
+
+    Wire.beginTransmission(m->adresse);
+    Wire.write(UBLOX_REG_ANZAHL);
+    if(Wire.endTransmission(false) != 0 || Wire.requestFrom(m->adresse, (uint8_t) 2) != 2) {
+      return;
+    }
+    m->ausstehend = (uint16_t) Wire.read() << 8;
+    m->ausstehend |= Wire.read();
+
+    // 0xFFFF: Modul hat gerade keine gültige Anzahl
+    if(m->ausstehend == 0xFFFF) {
+      m->ausstehend = 0;
+    }
+  }
+
+  uint16_t anzahl = min(m->ausstehend, (uint16_t) (m->groesse - ubloxBelegt(m)));
+  anzahl = min(anzahl, (uint16_t) UBLOX_STUECK);
+  if(anzahl == 0) {
+    return;
+  }
+
+  anzahl = Wire.requestFrom(m->adresse, (uint8_t) anzahl);
+  while(Wire.available() > 0) {
+    m->puffer[m->kopf++ & (m->groesse - 1)] = Wire.read();
+  }
+  m->ausstehend -= anzahl;
+}
+
+/**
+ * @brief u-blox-Module im Hintergrund abfragen
+ *
+ * Pro Aufruf kommt nur ein Modul dran, reihum, damit ein Modul mit viel
+ * Rückstand die anderen nicht aufhält.
+ */
+void ubloxAbfragen() {
+  if(transaktionOffen) {
+    return;
+  }
+
+  for(uint8_t i = 0; i < UBLOX_MODULE; i++) {
+    UbloxModul* m = &ubloxModule[ubloxNaechstes];
+    ubloxNaechstes = (ubloxNaechstes + 1) % UBLOX_MODULE;
+    if(m->adresse != 0) {
+      ubloxModulAbfragen(m);
+      return;
+    }
+  }
+}
+
+inline uint16_t ergebnisBelegt() {
+  return ergebnisKopf - ergebnisEnde;
+}
+
+/**
+ * @brief Byte in den Ergebnispuffer legen, bei vollem Puffer verwerfen
+ */
+void ergebnisSchreiben(uint8_t byte) {
+  if(ergebnisBelegt() < ERGEBNIS_PUFFER) {
+    ergebnisPuffer[ergebnisKopf++ & (ERGEBNIS_PUFFER - 1)] = byte;
+  }
+}
+
+/**
+ * @brief Schreibzugriffe des geladenen Programms prüfen
+ *
+ * Geht die Operationen der Reihe nach durch und lehnt Schreibzugriffe
+ * ab, die nicht in den Puffer der Wire-Library passen. Eine am Ende
+ * abgeschnittene Operation ist erlaubt, der Rest kommt mit dem nächsten
+ * 'M'.
+ *
+ * @return false, falls ein Schreibzugriff zu lang ist
+ */
+bool programmPruefen() {
+  uint8_t pc = 0;
+
+  while(pc < programmLaenge) {
+    uint8_t op = programm[pc++];
+
+    switch(op) {
+      case PRG_SCHREIBEN:
+      case PRG_SCHREIBEN_OS:
+        if(pc + 1 >= programmLaenge) {
+          return true;
+        }
+        if(programm[pc + 1] > PROGRAMM_SCHREIBEN_MAX) {
+          return false;
+        }
+        pc += 2 + programm[pc + 1];
+        break;
+
+      case PRG_LESEN:
+        pc += 2;
+        break;
+
+      case PRG_WARTEN:
+      case PRG_SCHLEIFE:
+      case PRG_BEI_NACK:
+      case PRG_MARKE:
+        pc++;
+        break;
+
+      case PRG_SCHLEIFE_ENDE:
+      case PRG_STATUS:
+      case PRG_ENDE:
+        break;
+
+      default:
+        return true; // fällt erst bei der Ausführung auf
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief Das gespeicherte Programm einmal ausführen
+ *
+ * @return 0, AD0LRB falls ein Zugriff nicht bestätigt wurde, oder BER
+ *         bei einem fehlerhaften Programm
+ * @see Programm
+ */
+uint8_t programmAusfuehren() {
+  uint8_t pc = 0;
+  uint8_t status = 0;  // Status des letzten Zugriffs
+  uint8_t gesamt = 0;  // Oder-Verknüpfung aller Zugriffe
+  uint8_t schleifeStart[PROGRAMM_SCHACHTELUNG];
+  uint8_t schleifeRest[PROGRAMM_SCHACHTELUNG];
+  uint8_t tiefe = 0;
+
+  while(pc < programmLaenge) {
+    uint8_t op = programm[pc++];
+    uint8_t rest = programmLaenge - pc; // verfügbare Parameterbytes
+
+    switch(op) {
+      case PRG_SCHREIBEN:
+      case PRG_SCHREIBEN_OS:
+        if(rest < 2 || rest - 2 < programm[pc + 1] || programm[pc + 1] > PROGRAMM_SCHREIBEN_MAX) {
+          return BER;
+        }
+        Wire.beginTransmission(programm[pc]);
+        Wire.write(&programm[pc + 2], programm[pc + 1]);
+        status = (Wire.endTransmission(op == PRG_SCHREIBEN) == 0) ? 0 : AD0LRB;
+        pc += 2 + programm[pc + 1];
+        break;
+
+      case PRG_LESEN: {
+        if(rest < 2 || programm[pc + 1] > PROGRAMM_LESEN_MAX) {
+          return BER;
+        }
+        uint8_t anzahl = Wire.requestFrom(programm[pc], programm[pc + 1]);
+        status = (anzahl == programm[pc + 1]) ? 0 : AD0LRB;
+        while(Wire.available() > 0) {
+          ergebnisSchreiben(Wire.read());
+        }
+        pc += 2;
+        break;
+      }
+
+      case PRG_WARTEN:
+        if(rest < 1) {
+          return BER;
+        }
+        delay(programm[pc++]);
+        break;
+
+      case PRG_SCHLEIFE:
+        if(rest < 1 || tiefe == PROGRAMM_SCHACHTELUNG) {
+          return BER;
+        }
+        schleifeRest[tiefe] = programm[pc++];
+        schleifeStart[tiefe] = pc;
+        tiefe++;
+        break;
+
+      case PRG_SCHLEIFE_ENDE:
+        if(tiefe == 0) {
+          return BER;
+        }
+        if(schleifeRest[tiefe - 1] > 1) {
+          schleifeRest[tiefe - 1]--;
+          pc = schleifeStart[tiefe - 1];
+        } else {
+          tiefe--;
+        }
+        break;
+
+      case PRG_BEI_NACK:
+        if(rest < 1) {
+          return BER;
+        }
+        pc++;
+        if(status != 0) {
+          pc = min((uint16_t) pc + programm[pc - 1], (uint16_t) programmLaenge);
+        }
+        break;
+
+      case PRG_MARKE:
+        if(rest < 1) {
+          return BER;
+        }
+        ergebnisSchreiben(programm[pc++]);
+        break;
+
+      case PRG_STATUS:
+        ergebnisSchreiben(status);
+        break;
+
+      case PRG_ENDE:
+        return gesamt;
+
+      default:
+        return BER;
+    }
+    gesamt |= status;
+  }
+
+  return gesamt;
+}
+
+/**
+ * @brief Das gespeicherte Programm periodisch ausführen, falls eingestellt
+ */
+void programmPeriodisch() {
+  if(programmPeriode == 0 || transaktionOffen) {
+    return;
+  }
+  if(millis() - programmLetzterLauf < (unsigned long) programmPeriode * PROGRAMM_TAKT) {
+    return;
+  }
+  programmLetzterLauf = millis();
+  programmAusfuehren();
+}
+
+/**
+ * @brief Inhalt eines Ringpuffers als Antwort auf 'F' oder 'I' senden
+ *
+ * Antwort: Befehl, Anzahl, Daten. Im Protokoll v2 höchstens
+ * #UBLOX_RAHMEN_MAX Bytes, im ursprünglichen Protokoll wird direkt an
+ * der seriellen Schnittstelle vorbei am Sendepuffer gesendet.
+ *
+ * @param message der Befehl, in message[1] die angefragte Anzahl
+ * @param puffer Ringpuffer
+ * @param groesse Größe des Ringpuffers (Zweierpotenz)
+ * @param ende Leseindex des Ringpuffers
+ * @param belegt Anzahl der Bytes im Ringpuffer
+ */
+void pufferAntworten(uint8_t* message, const uint8_t* puffer, uint16_t groesse, uint16_t* ende, uint16_t belegt) {
+  uint8_t anzahl = min((uint16_t) message[1], belegt);
+
+  if(v2Ziel != NULL) {
+    anzahl = min(anzahl, (uint8_t) UBLOX_RAHMEN_MAX);
+    message[1] = anzahl;
+    antworten(message, 2);
+    for(uint8_t i = 0; i < anzahl; i++) {
+      antworten(&puffer[(*ende)++ & (groesse - 1)], 1);
+    }
+    return;
+  }
+
+  // im ursprünglichen Protokoll direkt senden, vorher alle
+  // älteren Antworten loswerden
+  while(txKopf != txEnde) {
+    Serial.write(txPuffer[txEnde++ & (TX_GROESSE - 1)]);
+  }
+  message[1] = anzahl;
+  Serial.write(message, 2);
+  for(uint8_t i = 0; i < anzahl; i++) {
+    Serial.write(puffer[(*ende)++ & (groesse - 1)]);
+  }
+}
+
+/**
+ * @brief Pins des IO-Ports als Ausgänge schalten
+ */
+void portAusgang() {
+  if(ioAusgang) {
+    return;
+  }
+  for(uint8_t i = 0; i < 8; i++) {
+    pinMode(IO_0 + i, OUTPUT);
+  }
+  ioAusgang = true;
+}
+
+/**
+ * @brief Pins des IO-Ports als Eingänge schalten
+ */
+void portEingang() {
+  for(uint8_t i = 0; i < 8; i++) {
+    pinMode(IO_0 + i, INPUT);
+  }
+  ioAusgang = false;
+}
+
+/**
+ * @brief IO-Port lesen (Bit 0 von IO_0), bei Ausgängen der ausgegebene Wert
+ */
+inline uint8_t portLesen() {
+  uint8_t wert = 0;
+  for(uint8_t i = 0; i < 8; i++) {
+    if(*ioEingang[i] & ioMaske[i]) {
+      wert |= 1 << i;
+    }
+  }
+  return wert;
+}
+
+/**
+ * @brief Byte auf den IO-Port schreiben (Bit 0 auf IO_0)
+ *
+ * Schreibt direkt in die Portregister, da die Pins beim Arduino Micro
+ * über mehrere Ports verteilt sind. Außerhalb des Interrupts müssen die
+ * Interrupts gesperrt sein, sonst kann ein gleichzeitiger Zugriff des
+ * Timer-Interrupts auf dasselbe Register verloren gehen.
+ */
+inline void portSchreiben(uint8_t wert) {
+  for(uint8_t i = 0; i < 8; i++) {
+    if(wert & (1 << i)) {
+      *ioRegister[i] |= ioMaske[i];
+    } else {
+      *ioRegister[i] &= ~ioMaske[i];
+    }
+  }
+}
+
+/**
+ * @brief Nächsten Wert der Wertefolge ausgeben bzw. den Port abtasten
+ */
+ISR(TIMER1_COMPA_vect) {
+  uint8_t wert;
+
+  switch(portModus) {
+    case WELLE_WIEDERHOLEN:
+      if(portEnde == portKopf) {
+        return;
+      }
+      portSchreiben(portPuffer[portIndex++]);
+      if(portIndex == portKopf) {
+        portIndex = portEnde;
+      }
+      break;
+
+    case WELLE_STREAMING:
+      if(portEnde == portKopf) {
+        return; // Puffer leer: letzten Wert stehen lassen
+      }
+      portSchreiben(portPuffer[portEnde++]);
+      break;
+
+    case ERFASSUNG_TRIGGER:
+    case ERFASSUNG_AKTIV:
+      wert = portLesen();
+      if(portModus == ERFASSUNG_TRIGGER) {
+        if((wert & triggerMaske) != triggerWert) {
+          return;
+        }
+        portModus = ERFASSUNG_AKTIV;
+        erfassungZustand = ERFASSUNG_LAEUFT;
+      }
+      if((uint8_t) (portKopf + 1) == portEnde) {
+        TIMSK1 &= ~(1 << OCIE1A);
+        erfassungZustand = ERFASSUNG_UEBERLAUF;
+        return;
+      }
+      portPuffer[portKopf++] = wert;
+      if(--erfassungRest == 0) {
+        TIMSK1 &= ~(1 << OCIE1A);
+        erfassungZustand = 0;
+      }
+      break;
+  }
+}
+
+/**
+ * @brief Timer1 für Wertefolge oder Erfassung starten
+ *
+ * Timer1 läuft im CTC-Modus mit Vorteiler 8 (0,5µs), ab 32ms mit
+ * Vorteiler 64 (4µs).
+ *
+ * @param intervall Abstand der Werte in µs
+ */
+void timerStarten(uint16_t intervall) {
+  intervall = max(intervall, (uint16_t) WELLE_INTERVALL_MIN);
+
+  TCCR1A = 0;
+  if(intervall < 32768) {
+    TCCR1B = (1 << WGM12) | (1 << CS11);
+    OCR1A = intervall * 2 - 1;
+  } else {
+    TCCR1B = (1 << WGM12) | (1 << CS11) | (1 << CS10);
+    OCR1A = intervall / 4 - 1;
+  }
+  TCNT1 = 0;
+  TIMSK1 |= (1 << OCIE1A);
+}
+
+/**
+ * @brief Timer1 stoppen und den Puffer leeren
+ */
+void timerStoppen() {
+  TIMSK1 &= ~(1 << OCIE1A);
+  portKopf = portEnde = portIndex = 0;
+  erfassungZustand = 0;
+}
+
+/**
+ * @brief Ausgabe der Wertefolge starten oder stoppen
+ *
+ * @param modus WELLE_STREAMING oder WELLE_WIEDERHOLEN
+ * @param intervall Abstand der Werte in µs, 0 stoppt und leert den Puffer
+ */
+void welleStarten(uint8_t modus, uint16_t intervall) {
+  TIMSK1 &= ~(1 << OCIE1A);
+
+  if(intervall == 0) {
+    timerStoppen();
+    return;
+  }
+
+  // eine laufende Erfassung hat den Puffer belegt
+  if(portModus != WELLE_STREAMING && portModus != WELLE_WIEDERHOLEN) {
+    timerStoppen();
+  }
+
+  portAusgang();
+  portModus = modus;
+  portIndex = portEnde;
+  timerStarten(intervall);
+}
+
+/**
+ * @brief Erfassung am IO-Port starten oder stoppen
+ *
+ * Die Pins werden als Eingänge geschaltet, eine laufende Wertefolge wird
+ * abgebrochen.
+ *
+ * @param intervall Abstand der Abtastungen in µs, 0 stoppt
+ * @param maske Triggermaske, 0 startet sofort
+ * @param wert Triggerwert, die Erfassung beginnt bei (Port & maske) == wert
+ * @param anzahl Anzahl der Abtastungen, 0 stoppt
+ */
+void erfassungStarten(uint16_t intervall, uint8_t maske, uint8_t wert, uint16_t anzahl) {
+  timerStoppen();
+
+  if(intervall == 0 || anzahl == 0) {
+    return;
+  }
+
+  portEingang();
+  triggerMaske = maske;
+  triggerWert = wert & maske;
+  erfassungRest = anzahl;
+  portModus = maske ? ERFASSUNG_TRIGGER : ERFASSUNG_AKTIV;
+  erfassungZustand = maske ? ERFASSUNG_WARTET : ERFASSUNG_LAEUFT;
+  timerStarten(intervall);
+}
+
+/**
+ * @brief I2C-Takt möglichst nah am (und nicht über dem) Wunschwert einstellen
+ *
+ * Wire.setClock rechnet nur mit Vorteiler 1 und läuft unterhalb von etwa
+ * 31kHz über. Deshalb werden TWBR und der Vorteiler in TWSR hier selbst
+ * gesetzt: SCL = F_CPU / (16 + 2 * TWBR * 4^TWPS). Als Master braucht
+ * die TWI-Einheit TWBR >= #TWBR_MIN, außerdem ist der ATmega32U4 nur bis
+ * #TAKT_MAX spezifiziert; höhere Wunschwerte werden begrenzt.
+ *
+ * @param hz gewünschter Takt in Hz
+ * @return tatsächlich eingestellter Takt in Hz
+ */
+uint32_t taktSetzen(uint32_t hz) {
+  if(hz == 0 || hz > TAKT_MAX) {
+    hz = TAKT_MAX;
+  }
+
+#if defined(TWBR) && defined(TWSR)
+  uint8_t vorteiler = 0;
+  uint32_t zyklen, teiler;
+
+  // aufrunden, damit der Takt nie über dem Wunschwert liegt
+  zyklen = (F_CPU + hz - 1) / hz - 16;
+  teiler = (zyklen + 1) / 2;
+  while(teiler > 255 && vorteiler < 3) {
+    vorteiler++;
+    teiler = (zyklen + (2UL << (2 * vorteiler)) - 1) / (2UL << (2 * vorteiler));
+  }
+  if(teiler > 255) {
+    teiler = 255;
+  }
+  if(vorteiler == 0 && teiler < TWBR_MIN) {
+    teiler = TWBR_MIN;
+  }
+
+  TWSR = (TWSR & ~((1 << TWPS1) | (1 << TWPS0))) | vorteiler;
+  TWBR = teiler;
+  i2cTakt = F_CPU / (16 + (2UL << (2 * vorteiler)) * teiler);
+#else
+  Wire.setClock(hz);
+  i2cTakt = hz;
+#endif
+  return i2cTakt;
+}
+
 void setup() {
 
   /*pinMode(IO_RELAY, OUTPUT);
@@ -39,6 +984,14 @@ void setup() {
   pinMode(IO_6, OUTPUT);
   pinMode(IO_7, OUTPUT);*/
   
+  for(uint8_t i = 0; i < 8; i++) {
+    ioRegister[i] = portOutputRegister(digitalPinToPort(IO_0 + i));
+    ioEingang[i] = portInputRegister(digitalPinToPort(IO_0 + i));
+    ioMaske[i] = digitalPinToBitMask(IO_0 + i);
+  }
+
+  ubloxZuruecksetzen();
+
   Serial.begin(BAUDRATE);
   Wire.begin();
   //Serial.setTimeout(cTimeoutInMs);
@@ -46,18 +999,15 @@ void setup() {
   //i2c_init();
 }
 
-void loop() {
-  
-  // die ganze Nachricht empfangen
-  if(Serial.available() > 0) {
-
-    //Serial.print(Serial.available());
-    
-    // erstes Zeichen lesen, 
-    //Serial.readBytes(message, 2);
-    message[0] = Serial.read();
-    message[1] = Serial.read();
-  
+/**
+ * @brief Einen vollständig empfangenen Befehl ausführen
+ *
+ * Die Antwort wird mit #antworten in den Sendepuffer gelegt.
+ *
+ * @param message der Befehl, wird für die Antwort überschrieben
+ * @param laenge Länge des Befehls
+ */
+void bearbeiteBefehl(uint8_t* message, uint8_t laenge) {
 
     // Überprüfen, ob die Nachricht dem vorgegebenen Format entspricht
     switch(message[0]) {
@@ -65,42 +1015,46 @@ void loop() {
       // Startcondition zum Schreiben erzeugen
       case 'T':
       case 'U':
+        transaktionOffen = true;
         Wire.beginTransmission(message[1]);
         message[1] = 0;
-        Serial.write(message, 2);
+        antworten(message, 2);
         break;
       
       // Startcondition zum Lesen erzeugen
       case 'S':
       case 's':
-        Wire.requestFrom(message[1], 1);
+        transaktionOffen = true;
+        Wire.requestFrom(message[1], (uint8_t) 1);
         message[1] = 0;
-        Serial.write(message, 2);
+        antworten(message, 2);
         break;
 
       // Restart zum Lesen erzeugen
       case 'V':
       case 'v':
         // Kann die Arduino-Wire Library natürlich nicht.
-        Wire.requestFrom(message[1], 1);
+        transaktionOffen = true;
+        Wire.requestFrom(message[1], (uint8_t) 1);
         message[1] = 0;
-        Serial.write(message, 2);
+        antworten(message, 2);
         break;
 
       // Stop Condition Erzeugen
       case 'O':
         if(message[1] == 'P') {
           Wire.endTransmission();
+          transaktionOffen = false;
         } else {
           // Fehler
         }
-        Serial.write(message, 2);
+        antworten(message, 2);
         break;
 
       // Schreiben auf I2C-bus
       case 'N':
         Wire.write(message[1]);
-        Serial.write(message, 2);
+        antworten(message, 2);
         break;
 
       // Lesen vom I2C-Bus
@@ -109,32 +1063,51 @@ void loop() {
         // dass sie das richtige tut..
         message[1] = Wire.read();
         message[2] = 0;
-        Serial.write(message, 3);
+        antworten(message, 3);
         break;
 
       // I2C-Timing verändern
       case 'C':
         if(message[1] == SCL90) {
-          Wire.setClock(90000);
+          taktSetzen(90000);
         } else if(message[1] == SCL45) {
-          Wire.setClock(45000);
+          taktSetzen(45000);
         } else if(message[1] == SCL11) {
-          Wire.setClock(11000);
+          taktSetzen(11000);
         } else if(message[1] == SCL1_5) {
-          Wire.setClock(1500);
+          taktSetzen(1500);
+        } else if(message[1] == SCL100) {
+          taktSetzen(100000);
+        } else if(message[1] == SCL400) {
+          taktSetzen(400000);
         } else if(message[1] == 'Y' || message[1] == 'Z') {
           // Timeout-Verhalten definieren, momentan nicht implementiert
         } else {
           // Fehler
         }
-        Serial.write(message, 2);
+        antworten(message, 2);
+        break;
+
+      // beliebigen Takt setzen (3 Bytes in Hz, High zuerst) bzw. mit 0 nur
+      // abfragen, Antwort ist der tatsächlich eingestellte Takt
+      case 'K':
+        {
+          uint32_t hz = ((uint32_t) message[1] << 16) | ((uint32_t) message[2] << 8) | message[3];
+          if(hz != 0) {
+            taktSetzen(hz);
+          }
+          message[1] = (i2cTakt >> 16) & 0xFF;
+          message[2] = (i2cTakt >> 8) & 0xFF;
+          message[3] = i2cTakt & 0xFF;
+          antworten(message, 4);
+        }
         break;
 
       // Slave-Adresse setzen (und den Controller im Slave-Modus starten)
       case 'A':
         //Wire.begin(message[1]);
 
-        Serial.write(message, 2);
+        antworten(message, 2);
         break;
 
       // Slave-Adresse auslesen
@@ -142,36 +1115,68 @@ void loop() {
         if(message[1] == 'B') {
           message[1] = slaveAdress;
         }
-        Serial.write(message, 2);
+        antworten(message, 2);
         break;
 
       // Byte auf den IO-Port schreiben
       case 'W':
-        /*digitalWrite(IO_0, message[1]&0b00000001);
-        digitalWrite(IO_1, message[1]&0x00000010);
-        digitalWrite(IO_2, message[1]&0x00000100);
-        digitalWrite(IO_3, message[1]&0x00001000);
-        digitalWrite(IO_4, message[1]&0x00010000);
-        digitalWrite(IO_5, message[1]&0x00100000);
-        digitalWrite(IO_6, message[1]&0x01000000);
-        digitalWrite(IO_7, message[1]&0x10000000);*/
+        portAusgang();
+        noInterrupts();
+        portSchreiben(message[1]);
+        interrupts();
+
+        antworten(message, 2);
+        break;
 
+      // Werte für die Ausgabe am IO-Port anhängen: 'w' <Anzahl> <Werte...>,
+      // die Anzahl 0 fragt nur ab. Antwort: 'w' <freier Platz>
+      case 'w': {
+        uint8_t frei = PORT_PUFFER - 1 - (uint8_t) (portKopf - portEnde);
+        if(message[1] <= frei) {
+          for(uint8_t i = 0; i < message[1]; i++) {
+            portPuffer[(uint8_t) (portKopf + i)] = message[2 + i];
+          }
+          portKopf += message[1]; // erst jetzt für den Interrupt sichtbar
+          frei -= message[1];
+        }
+        message[1] = frei;
+        antworten(message, 2);
+        break;
+      }
 
-        Serial.write(message, 2);
+      // Ausgabe starten: 'Y' <Modus> <Intervall in µs, High> <Low>,
+      // Intervall 0 stoppt und leert den Puffer
+      case 'Y':
+        welleStarten(message[1], ((uint16_t) message[2] << 8) | message[3]);
+        antworten(message, 4);
         break;
 
       // Byte vom IO-Port lesen
       case 'D':
-       /* message[1] = digitalRead(IO_0);
-        message[1] += digitalRead(IO_1) << 1;
-        message[1] += digitalRead(IO_2) << 2;
-        message[1] += digitalRead(IO_3) << 3;
-        message[1] += digitalRead(IO_4) << 4;
-        message[1] += digitalRead(IO_5) << 5;
-        message[1] += digitalRead(IO_6) << 6;
-        message[1] += digitalRead(IO_7) << 7;*/
+        message[1] = portLesen();
+        antworten(message, 2);
+        break;
 
-        Serial.write(message, 2);
+      // Erfassung starten: 'd' <Intervall in µs, High> <Low> <Triggermaske>
+      // <Triggerwert> <Anzahl High> <Low>, Intervall oder Anzahl 0 stoppt
+      case 'd':
+        erfassungStarten(((uint16_t) message[1] << 8) | message[2], message[3], message[4],
+                         ((uint16_t) message[5] << 8) | message[6]);
+        antworten(message, 7);
+        break;
+
+      // erfasste Werte abholen, wie 'F'
+      case 'z': {
+        uint16_t ende = portEnde;
+        pufferAntworten(message, (const uint8_t*) portPuffer, PORT_PUFFER, &ende, (uint8_t) (portKopf - portEnde));
+        portEnde = ende;
+        break;
+      }
+
+      // Zustand der Erfassung
+      case 'Z':
+        message[1] = erfassungZustand;
+        antworten(message, 2);
         break;
         
 
@@ -184,7 +1189,7 @@ void loop() {
         } else {
           // Fehler
         }
-        Serial.write(message, 2);
+        antworten(message, 2);
         break;
         
       // Relais anziehen oder abfallen lassen
@@ -196,36 +1201,213 @@ void loop() {
         } else {
           // Fehler
         }
-        Serial.write(message, 2);
+        antworten(message, 2);
         break;*/
         
+      // Zeichen oder Befehle an ein HD44780-Display senden
+      // Aufbau: 'H' <Anzahl> <Adresse> <Modus> <Daten...>, bei der Anzahl 0
+      // wird nur mit 'HH' geantwortet (Abfrage, ob der Befehl bekannt ist).
+      case 'H':
+        if(message[1] == 0) {
+          message[1] = 'H';
+        } else {
+          message[1] = 0;
+          for(uint8_t i = 4; i < laenge; i++) {
+            if(hd44780Senden(message[2], message[3], message[i]) != 0) {
+              message[1] = AD0LRB; // kein Acknowledge vom PCF8574
+            }
+          }
+        }
+        antworten(message, 2);
+        break;
+
+      // u-blox-Modul an der angegebenen Adresse im Hintergrund abfragen,
+      // Adresse 0 schaltet die Abfrage ab
+      case 'G':
+        ubloxModule[0].adresse = message[1];
+        ubloxModule[0].ausstehend = 0;
+        antworten(message, 2);
+        break;
+
+      // weiteres u-blox-Modul: 'g' <Platz> <Adresse>, Adresse 0 schaltet
+      // die Abfrage des Platzes ab. Antwort: der Befehl, bei einem
+      // ungültigen Platz mit Adresse 0xFF
+      case 'g':
+        if(message[1] < UBLOX_MODULE) {
+          ubloxModule[message[1]].adresse = message[2];
+          ubloxModule[message[1]].ausstehend = 0;
+        } else {
+          message[2] = 0xFF;
+        }
+        antworten(message, 3);
+        break;
+
+      // gesammelte Daten des u-blox-Moduls abholen
+      // Antwort: 'F' <Anzahl> <Daten...>, höchstens so viele Bytes wie
+      // angefragt, im Protokoll v2 höchstens UBLOX_RAHMEN_MAX
+      case 'F':
+        pufferAntworten(message, ubloxModule[0].puffer, ubloxModule[0].groesse, &ubloxModule[0].ende,
+                        ubloxBelegt(&ubloxModule[0]));
+        break;
+
+      // gesammelte Daten eines weiteren Moduls: 'f' <Platz> <Anzahl>,
+      // Antwort wie bei 'F'
+      case 'f': {
+        UbloxModul* m = &ubloxModule[message[1] < UBLOX_MODULE ? message[1] : 0];
+        message[1] = message[1] < UBLOX_MODULE ? message[2] : 0;
+        pufferAntworten(message, m->puffer, m->groesse, &m->ende, ubloxBelegt(m));
+        break;
+      }
+
+      // Programm laden: 'M' <Anzahl> <Bytes...> hängt an das Programm an,
+      // die Anzahl 0 löscht es. Antwort: 'M' <Gesamtlänge>, 0xFF falls
+      // das Programm nicht in den Speicher passt oder ein Schreibzugriff
+      // länger als PROGRAMM_SCHREIBEN_MAX ist (das Stück wird verworfen)
+      case 'M':
+        if(message[1] == 0) {
+          programmLaenge = 0;
+          programmPeriode = 0;
+        } else if(programmLaenge + message[1] <= PROGRAMM_MAX) {
+          memcpy(&programm[programmLaenge], &message[2], message[1]);
+          programmLaenge += message[1];
+          if(!programmPruefen()) {
+            programmLaenge -= message[1];
+            message[1] = 0xFF;
+            antworten(message, 2);
+            break;
+          }
+        } else {
+          message[1] = 0xFF;
+          antworten(message, 2);
+          break;
+        }
+        message[1] = programmLaenge;
+        antworten(message, 2);
+        break;
+
+      // Programm ausführen: PROGRAMM_EINMAL führt es sofort aus (Antwort
+      // ist der Status), sonst Periode in PROGRAMM_TAKT ms, 0 stoppt
+      case 'J':
+        if(message[1] == PROGRAMM_EINMAL) {
+          message[1] = transaktionOffen ? BER : programmAusfuehren();
+        } else {
+          programmPeriode = message[1];
+          programmLetzterLauf = millis();
+        }
+        antworten(message, 2);
+        break;
+
+      // Ergebnisse des Programms abholen, wie 'F'
+      case 'I':
+        pufferAntworten(message, ergebnisPuffer, ERGEBNIS_PUFFER, &ergebnisEnde, ergebnisBelegt());
+        break;
+
       // Reset
       case 'X':
+        // nur im ursprünglichen Protokoll, sonst würde der Reset die
+        // Sequenznummern mitten im Fenster verschieben
+        if(v2Ziel == NULL) {
+          v2Zuruecksetzen();
+        }
+        for(uint8_t i = 0; i < UBLOX_MODULE; i++) {
+          ubloxModule[i].adresse = 0;
+        }
+        programmPeriode = 0;
+        welleStarten(WELLE_STREAMING, 0);
+        transaktionOffen = false;
 
-        Serial.write(message, 2);
+        antworten(message, 2);
         break;
 
+      // Fähigkeiten abfragen
+      case 'Q': {
+        uint8_t info[2 + FAEHIGKEITEN_LAENGE] = {
+          'Q', FAEHIGKEITEN_LAENGE,
+          PROTOKOLL_VERSION,
+          0, FAEHIG_V2 | FAEHIG_HD44780 | FAEHIG_UBLOX | FAEHIG_TAKT | FAEHIG_PROGRAMM | FAEHIG_WELLE |
+             FAEHIG_ERFASSUNG | FAEHIG_UBLOX_MEHR,
+          (BAUDRATE >> 16) & 0xFF, (BAUDRATE >> 8) & 0xFF, BAUDRATE & 0xFF,
+          0x3F, // SCL90 bis SCL400, kein SCL1000
+          highByte(RX_GROESSE), lowByte(RX_GROESSE),
+          highByte(TX_GROESSE), lowByte(TX_GROESSE),
+          highByte(UBLOX_PUFFER), lowByte(UBLOX_PUFFER),
+          PROGRAMM_MAX,
+          highByte(ERGEBNIS_PUFFER), lowByte(ERGEBNIS_PUFFER),
+          HD44780_MAX,
+          V2_FENSTER
+        };
+        antworten(info, sizeof(info));
+        break;
+      }
+
       // funktionslos
       case 'E':
-        if(message == 'E') {
+        if(message[1] == 'E') {
           // nichts tun...
         } else {
           // Fehler
         }
-        Serial.write(message, 2);
+        antworten(message, 2);
         break;
 
       default: // Fehlerhafte Nachricht empfangen.
                break;
+    }
+}
 
+void loop() {
 
+  uint8_t befehl[4 + HD44780_MAX];
+  uint8_t laenge;
 
-      
+  // alle angekommenen Bytes in den Empfangspuffer übernehmen, ohne zu warten
+  while(Serial.available() > 0 && rxBelegt() < RX_GROESSE) {
+    rxPuffer[rxKopf++ & (RX_GROESSE - 1)] = Serial.read();
+  }
+
+  // nur vollständige Befehle bearbeiten, und nur solange die Antwort
+  // sicher in den Sendepuffer passt
+  while(rxBelegt() >= 2 && txFrei() >= ANTWORT_MAX + V2_KOPF) {
+    if(rxLesen(0) == V2_START) {
+      if(!v2Empfangen()) {
+        break; // Rest des Rahmens ist noch nicht da
+      }
+      continue;
     }
 
+    if(v2Modus && !(rxLesen(0) == 'X' && rxLesen(1) == 'X')) {
+      rxEnde++; // Rest eines beschädigten Rahmens
+      continue;
+    }
+
+    laenge = befehlsLaenge(rxLesen(0), rxLesen(1));
+
+    if(laenge == 0) {
+      // ungültiges Byte verwerfen, um wieder synchron zu werden
+      rxEnde++;
+      continue;
+    }
 
+    if(rxBelegt() < laenge) {
+      break; // Rest des Befehls ist noch nicht da
+    }
 
-    //Serial.flush();
+    for(uint8_t i = 0; i < laenge; i++) {
+      befehl[i] = rxLesen(i);
+    }
+    rxEnde += laenge;
+
+    bearbeiteBefehl(befehl, laenge);
   }
 
+  v2Ausfuehren();
+
+  ubloxAbfragen();
+
+  programmPeriodisch();
+
+  // Antworten nur so weit senden, wie der serielle Puffer Platz hat
+  while(txKopf != txEnde && Serial.availableForWrite() > 0) {
+    Serial.write(txPuffer[txEnde++ & (TX_GROESSE - 1)]);
+  }
 }
@@ -1,5 +1,8 @@
 // Based on the work by DFRobot
 
+#include <stdio.h>
+#include <string.h>
+
 #include "LCD_I2C.h"
 #include "i2cusb/i2cusb.h"
 
@@ -10,17 +13,31 @@ inline size_t write(char value) {
 }
 */
 void writeChar(char value) {
+	_lcd->shownValid = 0;	// the shadow copy no longer matches the display
 	sendDisp(value, Rs);
 }
 
-char _Addr;
-char _displayfunction;
-char _displaycontrol;
-char _displaymode;
-char _numlines;
-char _cols;
-char _rows;
-char _backlightval;
+// the display all functions act on, see lcdSelect()
+lcdDisplay _lcdDefault;
+lcdDisplay* _lcd = &_lcdDefault;
+
+// set by flushAll(): offloaded writes are posted instead of waited for
+char _lcdBatch;
+
+// state file of saveState(): tag, the lcdDisplay struct, checksum
+#define LCD_STATE_TAG "LCDSTA01"
+#define LCD_STATE_TAG_LEN 8
+
+// FNV-1a, 32 bit, stored little endian after the struct
+static unsigned long stateChecksum(const lcdDisplay* lcd){
+	const unsigned char* d = (const unsigned char*) lcd;
+	unsigned long sum = 2166136261UL;
+
+	for (size_t i = 0; i < sizeof(*lcd); i++) {
+		sum = ((sum ^ d[i]) * 16777619UL) & 0xFFFFFFFFUL;
+	}
+	return sum;
+}
 
 
 
@@ -43,33 +60,139 @@ char _backlightval;
 // can't assume that its in that state when a sketch starts (and the
 // LiquidCrystal constructor is called).
 
+// Select the display the following calls act on. Until this is called
+// everything goes to a built-in default display.
+void lcdSelect(lcdDisplay* lcd){
+	_lcd = lcd;
+}
+
 void initDisp(char lcd_Addr,char lcd_cols,char lcd_rows)
 {
-  _Addr = lcd_Addr;
-  _cols = lcd_cols;
-  _rows = lcd_rows;
-  _backlightval = LCD_NOBACKLIGHT;
+  _lcd->addr = lcd_Addr;
+  _lcd->cols = lcd_cols;
+  _lcd->rows = lcd_rows;
+  _lcd->backlightval = LCD_NOBACKLIGHT;
+  _lcd->offload = hd44780_unterstuetzt();
+  _lcd->busyPoll = 0;
+  memset(_lcd->glyphValid, 0, sizeof(_lcd->glyphValid));
+  frameClear();
+  frameInvalidate();
 }
 
 void init(){
 	init_priv();
 }
 
+// Attach to a display that may still be configured from an earlier run
+// of the program, without the long reset and without blanking it. With
+// the state file written by saveState() only the mode registers are
+// reapplied and the next flush() only sends what changed; without it
+// the 4-bit interface is resynchronised and the next flush() redraws.
+// A file with the wrong tag, size or checksum counts as missing.
+// With busy flag polling the address counter is read back, and a
+// display that does not answer correctly (power cycled, garbled) gets
+// the full init(). Returns 1 for a warm attach, 0 after a cold init.
+int initWarm(const char* datei){
+	lcdDisplay gespeichert;
+	FILE* f = datei ? fopen(datei, "rb") : NULL;
+	char geladen = 0;
+	char tag[LCD_STATE_TAG_LEN];
+	unsigned char sum[4];
+
+	if (f) {
+		geladen = fread(tag, 1, LCD_STATE_TAG_LEN, f) == LCD_STATE_TAG_LEN
+				&& memcmp(tag, LCD_STATE_TAG, LCD_STATE_TAG_LEN) == 0
+				&& fread(&gespeichert, sizeof(gespeichert), 1, f) == 1
+				&& fread(sum, 1, 4, f) == 4
+				&& fgetc(f) == EOF
+				&& (sum[0] | ((unsigned long) sum[1] << 8) | ((unsigned long) sum[2] << 16)
+						| ((unsigned long) sum[3] << 24)) == stateChecksum(&gespeichert)
+				&& gespeichert.addr == _lcd->addr
+				&& gespeichert.cols == _lcd->cols && gespeichert.rows == _lcd->rows;
+		fclose(f);
+	}
+
+	if (geladen) {
+		_lcd->displayfunction = gespeichert.displayfunction;
+		_lcd->displaycontrol = gespeichert.displaycontrol;
+		_lcd->displaymode = gespeichert.displaymode;
+		_lcd->backlightval = gespeichert.backlightval;
+		memcpy(_lcd->shown, gespeichert.shown, sizeof(_lcd->shown));
+		_lcd->shownValid = gespeichert.shownValid;
+		memcpy(_lcd->glyphs, gespeichert.glyphs, sizeof(_lcd->glyphs));
+		memcpy(_lcd->glyphValid, gespeichert.glyphValid, sizeof(_lcd->glyphValid));
+	} else {
+		_lcd->displayfunction = LCD_4BITMODE | LCD_5x8DOTS
+				| (_lcd->rows > 1 ? LCD_2LINE : LCD_1LINE);
+		_lcd->displaycontrol = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
+		_lcd->displaymode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
+		// nothing is known about DDRAM and CGRAM, flush() redraws
+		_lcd->shownValid = 0;
+		memset(_lcd->glyphValid, 0, sizeof(_lcd->glyphValid));
+
+		// same sequence as begin(), works from 8-bit mode or either nibble
+		write4bits(0x03 << 4);
+		delayMicroseconds(4500);
+		write4bits(0x03 << 4);
+		delayMicroseconds(4500);
+		write4bits(0x03 << 4);
+		delayMicroseconds(150);
+		write4bits(0x02 << 4);
+	}
+	_lcd->numlines = _lcd->rows;
+
+	command(LCD_FUNCTIONSET | _lcd->displayfunction);
+	command(LCD_DISPLAYCONTROL | _lcd->displaycontrol);
+	command(LCD_ENTRYMODESET | _lcd->displaymode);
+	expanderWrite(0);	// backlight
+
+	if (_lcd->busyPoll && !_lcd->offload) {
+		char adresse = (_lcd->rows > 1 ? 0x40 : 0x00) + _lcd->cols - 1;
+		setCursor(_lcd->cols - 1, _lcd->rows > 1 ? 1 : 0);
+		if ((readStatus() & 0x7F) != adresse) {
+			init();
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// Save the state of the selected display for initWarm() on the next
+// start. Call it after flush(). Returns 0, or -1 if the file could not
+// be written.
+int saveState(const char* datei){
+	FILE* f = fopen(datei, "wb");
+	unsigned long sum = stateChecksum(_lcd);
+	unsigned char sumBytes[4] = { sum & 0xFF, (sum >> 8) & 0xFF, (sum >> 16) & 0xFF, (sum >> 24) & 0xFF };
+
+	if (!f) {
+		return -1;
+	}
+	if (fwrite(LCD_STATE_TAG, 1, LCD_STATE_TAG_LEN, f) != LCD_STATE_TAG_LEN
+			|| fwrite(_lcd, sizeof(*_lcd), 1, f) != 1
+			|| fwrite(sumBytes, 1, 4, f) != 4) {
+		fclose(f);
+		return -1;
+	}
+	return fclose(f) == 0 ? 0 : -1;
+}
+
 void init_priv()
 {
-	_displayfunction = LCD_4BITMODE | LCD_1LINE | LCD_5x8DOTS;
-	begin(_cols, _rows, LCD_5x8DOTS);
+	_lcd->displayfunction = LCD_4BITMODE | LCD_1LINE | LCD_5x8DOTS;
+	begin(_lcd->cols, _lcd->rows, LCD_5x8DOTS);
 }
 
 void begin(char cols, char lines, char dotsize) {
 	if (lines > 1) {
-		_displayfunction |= LCD_2LINE;
+		_lcd->displayfunction |= LCD_2LINE;
 	}
-	_numlines = lines;
+	_lcd->numlines = lines;
 
 	// for some 1 line displays you can select a 10 pixel high font
 	if ((dotsize != 0) && (lines == 1)) {
-		_displayfunction |= LCD_5x10DOTS;
+		_lcd->displayfunction |= LCD_5x10DOTS;
 	}
 
 	// SEE PAGE 45/46 FOR INITIALIZATION SPECIFICATION!
@@ -78,8 +201,10 @@ void begin(char cols, char lines, char dotsize) {
 	delay(50);
 
 	// Now we pull both RS and R/W low to begin commands
-	expanderWrite(_backlightval);	// reset expanderand turn backlight off (Bit 8 =1)
-	delay(1000);
+	expanderWrite(_lcd->backlightval);	// reset expanderand turn backlight off (Bit 8 =1)
+	if (!_lcd->busyPoll) {
+		delay(1000);
+	}
 
   	//put the LCD into 4 bit mode
 	// this is according to the hitachi HD44780 datasheet
@@ -102,20 +227,20 @@ void begin(char cols, char lines, char dotsize) {
 
 
 	// set # lines, font size, etc.
-	command(LCD_FUNCTIONSET | _displayfunction);
+	command(LCD_FUNCTIONSET | _lcd->displayfunction);
 
 	// turn the display on with no cursor or blinking default
-	_displaycontrol = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
+	_lcd->displaycontrol = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
 	display();
 
 	// clear it off
 	clear();
 
 	// Initialize to default text direction (for roman languages)
-	_displaymode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
+	_lcd->displaymode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
 
 	// set the entry mode
-	command(LCD_ENTRYMODESET | _displaymode);
+	command(LCD_ENTRYMODESET | _lcd->displaymode);
 
 	home();
 
@@ -124,50 +249,56 @@ void begin(char cols, char lines, char dotsize) {
 /********** high level commands, for the user! */
 void clear(){
 	command(LCD_CLEARDISPLAY);// clear display, set cursor position to zero
-	delayMicroseconds(2000);  // this command takes a long time!
+	if (!_lcd->offload) {
+		waitReady(2000);  // this command takes a long time!
+	}
+	memset(_lcd->shown, ' ', sizeof(_lcd->shown));
+	_lcd->shownValid = 1;
 }
 
 void home(){
 	command(LCD_RETURNHOME);  // set cursor position to zero
-	delayMicroseconds(2000);  // this command takes a long time!
+	if (!_lcd->offload) {
+		waitReady(2000);  // this command takes a long time!
+	}
 }
 
 void setCursor(char col, char row){
 	int row_offsets[] = { 0x00, 0x40, 0x14, 0x54 };
-	if ( row > _numlines ) {
-		row = _numlines-1;    // we count rows starting w/0
+	if ( row > _lcd->numlines ) {
+		row = _lcd->numlines-1;    // we count rows starting w/0
 	}
 	command(LCD_SETDDRAMADDR | (col + row_offsets[row]));
 }
 
 // Turn the display on/off (quickly)
 void noDisplay() {
-	_displaycontrol &= ~LCD_DISPLAYON;
-	command(LCD_DISPLAYCONTROL | _displaycontrol);
+	_lcd->displaycontrol &= ~LCD_DISPLAYON;
+	command(LCD_DISPLAYCONTROL | _lcd->displaycontrol);
 }
 void display() {
-	_displaycontrol |= LCD_DISPLAYON;
-	command(LCD_DISPLAYCONTROL | _displaycontrol);
+	_lcd->displaycontrol |= LCD_DISPLAYON;
+	command(LCD_DISPLAYCONTROL | _lcd->displaycontrol);
 }
 
 // Turns the underline cursor on/off
 void noCursor() {
-	_displaycontrol &= ~LCD_CURSORON;
-	command(LCD_DISPLAYCONTROL | _displaycontrol);
+	_lcd->displaycontrol &= ~LCD_CURSORON;
+	command(LCD_DISPLAYCONTROL | _lcd->displaycontrol);
 }
 void cursor() {
-	_displaycontrol |= LCD_CURSORON;
-	command(LCD_DISPLAYCONTROL | _displaycontrol);
+	_lcd->displaycontrol |= LCD_CURSORON;
+	command(LCD_DISPLAYCONTROL | _lcd->displaycontrol);
 }
 
 // Turn on and off the blinking cursor
 void noBlink() {
-	_displaycontrol &= ~LCD_BLINKON;
-	command(LCD_DISPLAYCONTROL | _displaycontrol);
+	_lcd->displaycontrol &= ~LCD_BLINKON;
+	command(LCD_DISPLAYCONTROL | _lcd->displaycontrol);
 }
 void blink() {
-	_displaycontrol |= LCD_BLINKON;
-	command(LCD_DISPLAYCONTROL | _displaycontrol);
+	_lcd->displaycontrol |= LCD_BLINKON;
+	command(LCD_DISPLAYCONTROL | _lcd->displaycontrol);
 }
 
 // These commands scroll the display without changing the RAM
@@ -180,26 +311,26 @@ void scrollDisplayRight(void) {
 
 // This is for text that flows Left to Right
 void leftToRight(void) {
-	_displaymode |= LCD_ENTRYLEFT;
-	command(LCD_ENTRYMODESET | _displaymode);
+	_lcd->displaymode |= LCD_ENTRYLEFT;
+	command(LCD_ENTRYMODESET | _lcd->displaymode);
 }
 
 // This is for text that flows Right to Left
 void rightToLeft(void) {
-	_displaymode &= ~LCD_ENTRYLEFT;
-	command(LCD_ENTRYMODESET | _displaymode);
+	_lcd->displaymode &= ~LCD_ENTRYLEFT;
+	command(LCD_ENTRYMODESET | _lcd->displaymode);
 }
 
 // This will 'right justify' text from the cursor
 void autoscroll(void) {
-	_displaymode |= LCD_ENTRYSHIFTINCREMENT;
-	command(LCD_ENTRYMODESET | _displaymode);
+	_lcd->displaymode |= LCD_ENTRYSHIFTINCREMENT;
+	command(LCD_ENTRYMODESET | _lcd->displaymode);
 }
 
 // This will 'left justify' text from the cursor
 void noAutoscroll(void) {
-	_displaymode &= ~LCD_ENTRYSHIFTINCREMENT;
-	command(LCD_ENTRYMODESET | _displaymode);
+	_lcd->displaymode &= ~LCD_ENTRYSHIFTINCREMENT;
+	command(LCD_ENTRYMODESET | _lcd->displaymode);
 }
 
 // Allows us to fill the first 8 CGRAM locations
@@ -207,20 +338,67 @@ void noAutoscroll(void) {
 void createChar(char location, char charmap[]) {
 	location &= 0x7; // we only have 8 locations 0-7
 	command(LCD_SETCGRAMADDR | (location << 3));
-	for (int i=0; i<8; i++) {
-		//write(charmap[i]);
-		sendDisp(charmap[i], Rs);
+	sendData(charmap, 8);
+
+	// keep the glyph cache in sync with the slot
+	memcpy(_lcd->glyphs[(int)location], charmap, 8);
+	_lcd->glyphValid[(int)location] = 1;
+	_lcd->glyphUsed[(int)location] = ++_lcd->glyphClock;
+}
+
+// Return the character code (0-7) showing the given 8 row bitmap. A
+// glyph already in CGRAM is reused, otherwise it is uploaded into a
+// free slot or the least recently used one that is not on the
+// framebuffer. Returns -1 if all 8 slots are on the framebuffer.
+// An upload leaves the address counter in CGRAM, so set the cursor
+// (or flush()) before writing text again.
+int glyph(char charmap[]) {
+	int slot = -1;
+
+	for (int i = 0; i < 8; i++) {
+		if (_lcd->glyphValid[i] && memcmp(_lcd->glyphs[i], charmap, 8) == 0) {
+			_lcd->glyphUsed[i] = ++_lcd->glyphClock;
+			return i;
+		}
+	}
+
+	for (int i = 0; i < 8; i++) {
+		if (!_lcd->glyphValid[i]) {
+			slot = i;
+			break;
+		}
+		if (!glyphVisible(i) && (slot < 0 || _lcd->glyphUsed[i] < _lcd->glyphUsed[slot])) {
+			slot = i;
+		}
+	}
+	if (slot < 0) {
+		return -1;
+	}
+
+	createChar(slot, charmap);
+	return slot;
+}
+
+// is the character code (or its alias 8-15) somewhere on the framebuffer?
+char glyphVisible(int slot) {
+	for (int row = 0; row < LCD_MAX_ROWS; row++) {
+		for (int col = 0; col < LCD_MAX_COLS; col++) {
+			if ((_lcd->frame[row][col] & 0xF7) == slot) {
+				return 1;
+			}
+		}
 	}
+	return 0;
 }
 
 // Turn the (optional) backlight off/on
 void noBacklight(void) {
-	_backlightval=LCD_NOBACKLIGHT;
+	_lcd->backlightval=LCD_NOBACKLIGHT;
 	expanderWrite(0);
 }
 
 void backlight(void) {
-	_backlightval=LCD_BACKLIGHT;
+	_lcd->backlightval=LCD_BACKLIGHT;
 	expanderWrite(0);
 }
 
@@ -237,29 +415,137 @@ inline void command(char value) {
 
 // write either command or data
 void sendDisp(char value, char mode) {
-	char highnib=value&0xf0;
-	char lownib=(value<<4)&0xf0;
-    write4bits((highnib)|mode);
-	write4bits((lownib)|mode);
+	if (_lcd->offload) {
+		if (_lcdBatch) {
+			hd44780_posten(_lcd->addr, mode | _lcd->backlightval, &value, 1);
+		} else {
+			hd44780_schreiben(_lcd->addr, mode | _lcd->backlightval, &value, 1);
+		}
+		return;
+	}
+	sendBytes(&value, 1, mode);
+}
+
+// Write characters or commands in a single PCF8574 transaction: every
+// byte after the address goes straight to the expander pins. A bus byte
+// takes 9 SCL clocks, which already covers the >450ns enable pulse.
+void sendBytes(char* str, unsigned int len, char mode) {
+	char puffer[64];
+	unsigned int pad = settleBytes();
+	unsigned int n = 0;
+
+	start_iic(true, _lcd->addr, 'w');
+	for(unsigned int i = 0; i < len; i++) {
+		if (n + 6 + pad > sizeof(puffer)) {
+			wr_bytes_iic(puffer, n);
+			n = 0;
+		}
+		n += nibbleBytes(&puffer[n], (str[i] & 0xf0) | mode);
+		n += nibbleBytes(&puffer[n], ((str[i] << 4) & 0xf0) | mode);
+		for(unsigned int j = 0; j < pad; j++) {
+			puffer[n] = puffer[n-1];	// idle with En low
+			n++;
+		}
+	}
+	wr_bytes_iic(puffer, n);
+	stop_iic();
+}
+
+// Extra idle bytes after a character so the next one is not latched
+// before the controller is ready (commands need > 37us, 50us are used).
+// The next latch is three bytes away, which is enough up to ~500 kHz.
+unsigned int settleBytes() {
+	unsigned long bytes = (adapter_info()->takt * 50 + 8999999) / 9000000;
+	return bytes > 3 ? bytes - 3 : 0;
+}
+
+// expander bytes for one nibble: data, En high, En low
+unsigned int nibbleBytes(char* puffer, char value) {
+	puffer[0] = value | _lcd->backlightval;
+	puffer[1] = (value | En) | _lcd->backlightval;
+	puffer[2] = (value & ~En) | _lcd->backlightval;
+	return 3;
 }
 
 void write4bits(char value) {
-	expanderWrite(value);
-	pulseEnable(value);
+	char puffer[3];
+	start_iic(true, _lcd->addr, 'w');
+	wr_bytes_iic(puffer, nibbleBytes(puffer, value));
+	stop_iic();
 }
 
-void expanderWrite(char _data){
-	start_iic(true, _Addr, 'w');
-	wr_byte_iic((int)(_data) | _backlightval);
+// Enable busy flag polling. Needs R/W of the display wired to the
+// expander (bit 1); call it between initDisp() and init() to also skip
+// the long power-up wait in begin().
+void busyFlag(char on){
+	_lcd->busyPoll = on;
+}
+
+// Wait until the controller has finished the last command, at most
+// the given worst case. If the flag never clears R/W is not connected:
+// polling is switched off and the fixed delays are used from then on.
+void waitReady(unsigned int micros){
+	if (_lcd->busyPoll) {
+		for (int i = 0; i < LCD_BUSY_POLL_MAX; i++) {
+			if (!readBusy()) {
+				return;
+			}
+		}
+		_lcd->busyPoll = 0;
+	}
+	delayMicroseconds(micros);
+}
+
+// read the busy flag (D7) through the PCF8574
+char readBusy(){
+	char puffer[3];
+	char wert = readNibble();
+
+	// En low, and clock out the low nibble to finish the 4-bit read
+	puffer[0] = 0xF0 | Rw | _lcd->backlightval;
+	puffer[1] = 0xF0 | Rw | En | _lcd->backlightval;
+	puffer[2] = 0xF0 | Rw | _lcd->backlightval;
+	start_iic(true, _lcd->addr, 'w');
+	wr_bytes_iic(puffer, 3);
 	stop_iic();
+
+	return wert & 0x80;
 }
 
-void pulseEnable(char _data){
-	expanderWrite(_data | En);	// En high
-	delayMicroseconds(1);		// enable pulse must be >450ns
+// read busy flag and address counter (BF | AC)
+char readStatus(){
+	char wert = readNibble();
+	wert |= (readNibble() >> 4) & 0x0F;
+	expanderWrite((char) (0xF0 | Rw));	// En low
+	return wert;
+}
 
-	expanderWrite(_data & ~En);	// En low
-	delayMicroseconds(50);		// commands need > 37us to settle
+// Raise En with R/W set and return the data pins (upper nibble). The
+// data pins are written high first so the display can pull them low.
+char readNibble(){
+	char puffer[2];
+	char wert = 0;
+
+	puffer[0] = 0xF0 | Rw | _lcd->backlightval;
+	puffer[1] = 0xF0 | Rw | En | _lcd->backlightval;
+	start_iic(true, _lcd->addr, 'w');
+	wr_bytes_iic(puffer, 2);
+	stop_iic();
+
+	start_iic(true, _lcd->addr, 'r');
+	if (!adapter_info()->i2cMicro) {
+		rd_byte_iic(&wert, true);	// PCD8584: dummy read first
+	}
+	rd_byte_iic(&wert, true);
+	stop_iic();
+
+	return wert & 0xF0;
+}
+
+void expanderWrite(char _data){
+	start_iic(true, _lcd->addr, 'w');
+	wr_byte_iic((int)(_data) | _lcd->backlightval);
+	stop_iic();
 }
 
 
@@ -297,7 +583,128 @@ void printstr(char* str, unsigned int len){
 	//This function is not identical to the function used for "real" I2C displays
 	//it's here so the user sketch doesn't have to be changed
 	//print(c);
+	_lcd->shownValid = 0;
+	sendData(str, len);
+}
+
+// write a run of characters at the current DDRAM address
+void sendData(char* str, unsigned int len){
+	if (_lcd->offload) {
+		if (_lcdBatch) {
+			hd44780_posten(_lcd->addr, Rs | _lcd->backlightval, str, len);
+		} else {
+			hd44780_schreiben(_lcd->addr, Rs | _lcd->backlightval, str, len);
+		}
+		return;
+	}
+	sendBytes(str, len, Rs);
+}
+
+
+/*********** framebuffer */
+
+// Draw into the framebuffer with frameSetCursor/framePrint/frameWriteChar, then
+// call flush(): only the cells that differ from what the display shows
+// are sent. Mixing in direct writes (printstr, writeChar) forces the
+// next flush to redraw everything. flush() assumes the default entry
+// mode (left to right, no autoscroll).
+
+void frameClear(){
+	memset(_lcd->frame, ' ', sizeof(_lcd->frame));
+	_lcd->frameCol = 0;
+	_lcd->frameRow = 0;
+}
+
+void frameSetCursor(char col, char row){
+	_lcd->frameCol = col;
+	_lcd->frameRow = row;
+}
+
+void frameWriteChar(char value){
+	if (_lcd->frameRow >= 0 && _lcd->frameRow < _lcd->rows && _lcd->frameRow < LCD_MAX_ROWS
+			&& _lcd->frameCol >= 0 && _lcd->frameCol < _lcd->cols && _lcd->frameCol < LCD_MAX_COLS) {
+		_lcd->frame[(int)_lcd->frameRow][(int)_lcd->frameCol] = value;
+	}
+	_lcd->frameCol++;	// text past the end of the row is clipped
+}
+
+void framePrint(char* str, unsigned int len){
 	for(unsigned int i = 0; i < len; i++) {
-        writeChar(str[i]);
+		frameWriteChar(str[i]);
+	}
+}
+
+// forget what the display shows, the next flush redraws everything
+void frameInvalidate(){
+	_lcd->shownValid = 0;
+}
+
+void flush(){
+	char rows = _lcd->rows < LCD_MAX_ROWS ? _lcd->rows : LCD_MAX_ROWS;
+
+	for (char row = 0; row < rows; row++) {
+		flushRow(row);
+	}
+	_lcd->shownValid = 1;
+}
+
+// Flush several displays at once. The rows are sent alternating between
+// the displays, and with adapter offload all writes are posted and only
+// waited for at the end, so the updates share the bus bursts instead of
+// one display waiting for the other. The selected display is kept.
+void flushAll(lcdDisplay* lcds[], int anzahl){
+	lcdDisplay* gewaehlt = _lcd;
+
+	_lcdBatch = 1;
+	for (char row = 0; row < LCD_MAX_ROWS; row++) {
+		for (int i = 0; i < anzahl; i++) {
+			_lcd = lcds[i];
+			if (row < _lcd->rows) {
+				flushRow(row);
+			}
+		}
+	}
+	_lcdBatch = 0;
+	hd44780_abschliessen();
+
+	for (int i = 0; i < anzahl; i++) {
+		lcds[i]->shownValid = 1;
+	}
+	_lcd = gewaehlt;
+}
+
+// send the changed runs of one row
+void flushRow(char row){
+	char cols = _lcd->cols < LCD_MAX_COLS ? _lcd->cols : LCD_MAX_COLS;
+	char col = 0;
+	char cursorCol = -1;	// where the display's address counter is in this row
+
+	while (col < cols) {
+		// find the next changed cell
+		if (_lcd->shownValid && _lcd->frame[(int)row][(int)col] == _lcd->shown[(int)row][(int)col]) {
+			col++;
+			continue;
+		}
+
+		// extend the run; an unchanged gap of one cell costs as much to
+		// resend as the cursor move after it, so it is bridged
+		char end = col + 1;
+		while (end < cols) {
+			if (!_lcd->shownValid || _lcd->frame[(int)row][(int)end] != _lcd->shown[(int)row][(int)end]) {
+				end++;
+			} else if (end + 1 < cols && _lcd->frame[(int)row][end + 1] != _lcd->shown[(int)row][end + 1]) {
+				end += 2;
+			} else {
+				break;
+			}
+		}
+
+		if (cursorCol != col) {
+			setCursor(col, row);
+		}
+		sendData(&_lcd->frame[(int)row][(int)col], end - col);
+		memcpy(&_lcd->shown[(int)row][(int)col], &_lcd->frame[(int)row][(int)col], end - col);
+		cursorCol = end;
+		col = end;
 	}
 }
@@ -45,10 +45,47 @@
 #define LCD_BACKLIGHT 0x08
 #define LCD_NOBACKLIGHT 0x00
 
+// size of the framebuffer (largest supported display)
+#define LCD_MAX_COLS 20
+#define LCD_MAX_ROWS 4
+
+// busy flag reads before falling back to the fixed delays
+#define LCD_BUSY_POLL_MAX 10
+
 #define En 0b00000100  // Enable bit
 #define Rw 0b00000010  // Read/Write bit
 #define Rs 0b00000001  // Register select bit
 
+// state of one display, several can share the bus (PCF8574 at 0x20-0x27,
+// PCF8574A at 0x38-0x3F)
+typedef struct lcdDisplay {
+	char addr;
+	char displayfunction;
+	char displaycontrol;
+	char displaymode;
+	char numlines;
+	char cols;
+	char rows;
+	char backlightval;
+	char offload;		// adapter handles nibbles, enable pulse and timing ('H')
+	char busyPoll;		// poll the busy flag instead of the worst case delays
+
+	// framebuffer: frame is what the user wants to see, shown what the
+	// display currently shows (only trusted while shownValid is set)
+	char frame[LCD_MAX_ROWS][LCD_MAX_COLS];
+	char shown[LCD_MAX_ROWS][LCD_MAX_COLS];
+	char shownValid;
+	char frameCol;
+	char frameRow;
+
+	// CGRAM glyph cache: content of the 8 slots and when they were last used
+	char glyphs[8][8];
+	char glyphValid[8];
+	unsigned long glyphUsed[8];
+	unsigned long glyphClock;
+} lcdDisplay;
+
+extern void lcdSelect(lcdDisplay* lcd);
 extern void initDisp(char lcd_Addr, char lcd_cols, char lcd_rows);
 extern void begin(char cols, char rows, char charsize);
 extern void clear();
@@ -76,6 +113,8 @@ extern void setCursor(char, char);
 extern void writeChar(char);  //TODO: Nutzung prüfen und evtl. ersetzen/entfernen (im Original virtual void oder virtual size_t)
 extern void command(char);
 extern void init();
+extern int initWarm(const char* datei);
+extern int saveState(const char* datei);
 
 ////compatibility API function aliases
 extern void blink_on();						// alias for blink()
@@ -85,19 +124,34 @@ extern void cursor_off();      					// alias for noCursor()
 extern void setBacklight(char new_val);				// alias for backlight() and nobacklight()
 extern void load_custom_character(char char_num, char *rows);	// alias for createChar()
 extern void printstr(char*, unsigned int len);
+extern void busyFlag(char on);
+extern int glyph(char[]);
+
+// framebuffer, see flush()
+extern void frameClear();
+extern void frameSetCursor(char col, char row);
+extern void frameWriteChar(char);
+extern void framePrint(char*, unsigned int len);
+extern void frameInvalidate();
+extern void flush();
+extern void flushAll(lcdDisplay* lcds[], int anzahl);
 
 //Private functions
 extern void init_priv();
 extern void sendDisp(char, char);
 extern void write4bits(char);
 extern void expanderWrite(char);
-extern void pulseEnable(char);
-extern char _Addr;
-extern char _displayfunction;
-extern char _displaycontrol;
-extern char _displaymode;
-extern char _numlines;
-extern char _cols;
-extern char _rows;
-extern char _backlightval;
+extern void sendData(char*, unsigned int len);
+extern void flushRow(char row);
+extern void sendBytes(char*, unsigned int len, char mode);
+extern void waitReady(unsigned int micros);
+extern char readBusy();
+extern char readStatus();
+extern char readNibble();
+extern char glyphVisible(int slot);
+extern unsigned int settleBytes();
+extern unsigned int nibbleBytes(char*, char);
+extern lcdDisplay _lcdDefault;
+extern lcdDisplay* _lcd;
+extern char _lcdBatch;
 #endif
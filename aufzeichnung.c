@@ -0,0 +1,235 @@
+/**
+ * @file aufzeichnung.c
+ *
+ * @brief Aufzeichnung des rohen Datenstroms des u-blox NEO-7M GPS-Moduls
+ *
+ * Das Schreiben läuft über eine globale Datei, die #ublox_aufzeichnen
+ * benutzt. Sie hat eine eigene Sperre, damit der GPS-Lesethread erst nach
+ * #bus_freigeben schreiben kann und andere Threads nicht auf die Platte
+ * warten müssen, nur weil sie den Bus brauchen. Das Lesen arbeitet nur
+ * auf einem Speicherbereich (z.B. einer mit mmap eingeblendeten Datei)
+ * und hat keinen Zustand.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "aufzeichnung.h"
+
+/**
+ * Datei der laufenden Aufzeichnung, NULL wenn keine läuft.
+ */
+FILE* aufzeichnungsDatei = NULL;
+pthread_mutex_t aufzeichnungsSperre = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Interne Funktion, Datei schließen, Sperre muss gehalten werden
+ */
+static void schliessen(void) {
+    if(aufzeichnungsDatei != NULL) {
+        fclose(aufzeichnungsDatei);
+        aufzeichnungsDatei = NULL;
+    }
+}
+
+/**
+ * @brief Aufzeichnung starten bzw. an eine vorhandene Datei anhängen
+ *
+ * Darf auch bei laufendem GPS-Lesethread aufgerufen werden, eine schon
+ * laufende Aufzeichnung wird beendet.
+ *
+ * @param datei Name der Aufzeichnungsdatei
+ * @return 0 bei Erfolg, -1 im Fehlerfall
+ */
+int aufzeichnung_starten(const char* datei) {
+    FILE* f;
+
+    aufzeichnung_beenden();
+
+    f = fopen(datei, "ab");
+    if(f == NULL) {
+        fprintf(stderr, "aufzeichnung_starten: %s konnte nicht geöffnet werden!\n", datei);
+        return -1;
+    }
+
+    // neue Datei: Kennung schreiben
+    if(fseek(f, 0, SEEK_END) == 0 && ftell(f) == 0) {
+        if(fwrite(AUFZEICHNUNG_KENNUNG, 1, AUFZEICHNUNG_KENNUNG_LAENGE, f) != AUFZEICHNUNG_KENNUNG_LAENGE) {
+            fprintf(stderr, "aufzeichnung_starten: Schreiben der Kennung fehlgeschlagen!\n");
+            fclose(f);
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&aufzeichnungsSperre);
+    schliessen();
+    aufzeichnungsDatei = f;
+    pthread_mutex_unlock(&aufzeichnungsSperre);
+    return 0;
+}
+
+/**
+ * @brief Laufende Aufzeichnung beenden
+ */
+void aufzeichnung_beenden(void) {
+    pthread_mutex_lock(&aufzeichnungsSperre);
+    schliessen();
+    pthread_mutex_unlock(&aufzeichnungsSperre);
+}
+
+/**
+ * @brief Ein Stück des Datenstroms an die laufende Aufzeichnung anhängen
+ *
+ * Ohne laufende Aufzeichnung passiert nichts. Jedes Stück wird sofort
+ * geschrieben, damit bei einem Absturz im Feld höchstens das letzte
+ * verloren geht. Bei einem Schreibfehler wird die Aufzeichnung beendet.
+ *
+ * @param daten gelesene Daten
+ * @param laenge Anzahl der Bytes, längere Stücke werden aufgeteilt
+ */
+void aufzeichnung_anhaengen(const char* daten, unsigned int laenge) {
+    unsigned char kopf[AUFZEICHNUNG_KOPF];
+    unsigned long long zeit;
+    struct timespec jetzt;
+
+    if(laenge == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&aufzeichnungsSperre);
+    if(aufzeichnungsDatei == NULL) {
+        pthread_mutex_unlock(&aufzeichnungsSperre);
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &jetzt);
+    zeit = (unsigned long long) jetzt.tv_sec * 1000000ULL + jetzt.tv_nsec / 1000;
+
+    while(laenge > 0) {
+        unsigned int n = laenge > AUFZEICHNUNG_STUECK_MAX ? AUFZEICHNUNG_STUECK_MAX : laenge;
+
+        kopf[0] = AUFZEICHNUNG_MARKE1;
+        kopf[1] = AUFZEICHNUNG_MARKE2;
+        kopf[2] = (unsigned char) (n & 0xFF);
+        kopf[3] = (unsigned char) (n >> 8);
+        for(int i = 0; i < 8; i++) {
+            kopf[4+i] = (unsigned char) (zeit >> (8*i));
+        }
+
+        if(fwrite(kopf, 1, sizeof(kopf), aufzeichnungsDatei) != sizeof(kopf)
+                || fwrite(daten, 1, n, aufzeichnungsDatei) != n
+                || fflush(aufzeichnungsDatei) != 0) {
+            fprintf(stderr, "aufzeichnung_anhaengen: Schreiben fehlgeschlagen, Aufzeichnung beendet!\n");
+            schliessen();
+            break;
+        }
+
+        daten += n;
+        laenge -= n;
+    }
+
+    pthread_mutex_unlock(&aufzeichnungsSperre);
+}
+
+/**
+ * @brief Prüfen, ob ein Speicherbereich mit der Dateikennung beginnt
+ */
+bool aufzeichnung_pruefen(const char* daten, size_t groesse) {
+    return groesse >= AUFZEICHNUNG_KENNUNG_LAENGE
+            && memcmp(daten, AUFZEICHNUNG_KENNUNG, AUFZEICHNUNG_KENNUNG_LAENGE) == 0;
+}
+
+/**
+ * @brief Interne Funktion, liegt bei pos ein vollständiger Stückkopf?
+ * @return Länge der Daten, -1 falls nicht
+ */
+static long kopfLesen(const unsigned char* d, size_t groesse, size_t pos) {
+    long laenge;
+
+    if(pos + AUFZEICHNUNG_KOPF > groesse
+            || d[pos] != AUFZEICHNUNG_MARKE1 || d[pos+1] != AUFZEICHNUNG_MARKE2) {
+        return -1;
+    }
+
+    laenge = d[pos+2] | ((long) d[pos+3] << 8);
+    if(pos + AUFZEICHNUNG_KOPF + laenge > groesse) {
+        return -1;
+    }
+
+    return laenge;
+}
+
+/**
+ * @brief Nächstes Stück einer Aufzeichnung lesen
+ *
+ * @param daten Aufzeichnung
+ * @param groesse Größe der Aufzeichnung
+ * @param pos Position eines Stückkopfs, wird auf das folgende Stück gesetzt
+ * @param s Ziel für das Stück
+ * @return false am Ende, bei einem abgeschnittenen letzten Stück oder
+ *     wenn bei pos kein Stückkopf liegt
+ */
+bool aufzeichnung_lesen(const char* daten, size_t groesse, size_t* pos, aufzeichnungStueck* s) {
+    const unsigned char* d = (const unsigned char*) daten;
+    long laenge = kopfLesen(d, groesse, *pos);
+
+    if(laenge < 0) {
+        return false;
+    }
+
+    s->zeit = 0;
+    for(int i = 7; i >= 0; i--) {
+        s->zeit = (s->zeit << 8) | d[*pos + 4 + i];
+    }
+    s->daten = daten + *pos + AUFZEICHNUNG_KOPF;
+    s->laenge = (unsigned int) laenge;
+
+    *pos += AUFZEICHNUNG_KOPF + laenge;
+    return true;
+}
+
+/**
+ * @brief Ab einer beliebigen Stelle den nächsten Stückkopf suchen
+ *
+ * Ein Kopf gilt als gefunden, wenn nach seinen Daten das Dateiende oder
+ * ein weiterer Kopf folgt. Die Marken allein könnten auch in den Daten
+ * vorkommen.
+ *
+ * @param daten Aufzeichnung
+ * @param groesse Größe der Aufzeichnung
+ * @param pos Startposition
+ * @return Position des Kopfs, groesse falls keiner mehr folgt
+ */
+size_t aufzeichnung_synchronisieren(const char* daten, size_t groesse, size_t pos) {
+    const unsigned char* d = (const unsigned char*) daten;
+
+    if(pos < AUFZEICHNUNG_KENNUNG_LAENGE) {
+        pos = AUFZEICHNUNG_KENNUNG_LAENGE;
+    }
+
+    for(; pos + AUFZEICHNUNG_KOPF <= groesse; pos++) {
+        const unsigned char* marke = memchr(d + pos, AUFZEICHNUNG_MARKE1, groesse - pos);
+        long laenge;
+        size_t naechster;
+
+        if(marke == NULL) {
+            break;
+        }
+        pos = marke - d;
+
+        laenge = kopfLesen(d, groesse, pos);
+        if(laenge < 0) {
+            continue;
+        }
+        naechster = pos + AUFZEICHNUNG_KOPF + laenge;
+        if(naechster == groesse || kopfLesen(d, groesse, naechster) >= 0) {
+            return pos;
+        }
+    }
+
+    return groesse;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file aufzeichnung.h
+ *
+ * @brief Aufzeichnung des rohen Datenstroms des u-blox NEO-7M GPS-Moduls
+ *
+ * Solange eine Aufzeichnung läuft, hängt #drainUblox bzw.
+ * #ublox_aufzeichnen jedes gelesene Stück unverändert an eine Datei an. Mit gpsreplay lassen sich solche
+ * Dateien später erneut durch den Parser schicken.
+ *
+ * Aufbau der Datei (alle Zahlen Little-Endian):
+ *  - Kennung #AUFZEICHNUNG_KENNUNG (8 Bytes), nur am Dateianfang
+ *  - beliebig viele Stücke aus
+ *     - Marke #AUFZEICHNUNG_MARKE1, #AUFZEICHNUNG_MARKE2
+ *     - Länge der Daten (2 Bytes)
+ *     - Empfangszeit in µs seit 1970, CLOCK_REALTIME (8 Bytes)
+ *     - Daten
+ *
+ * Weitere Aufzeichnungen werden an eine vorhandene Datei angehängt. Über
+ * die Marken findet #aufzeichnung_synchronisieren von einer beliebigen
+ * Stelle aus den nächsten Stückkopf, sodass sich eine Datei in
+ * Abschnitte aufteilen lässt.
+ */
+
+#ifndef AUFZEICHNUNG_H_
+#define AUFZEICHNUNG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define AUFZEICHNUNG_KENNUNG "GPSAUF01"   /*!< Dateikennung mit Formatversion */
+#define AUFZEICHNUNG_KENNUNG_LAENGE 8
+#define AUFZEICHNUNG_MARKE1 0xC5          /*!< erstes Byte eines Stückkopfs */
+#define AUFZEICHNUNG_MARKE2 0x7A          /*!< zweites Byte eines Stückkopfs */
+#define AUFZEICHNUNG_KOPF 12              /*!< Länge eines Stückkopfs */
+#define AUFZEICHNUNG_STUECK_MAX 0xFFFF    /*!< größte Datenlänge eines Stücks */
+
+/**
+ * @brief Ein Stück einer Aufzeichnung
+ */
+typedef struct aufzeichnungStueck {
+    unsigned long long zeit;   /*!< Empfangszeit in µs seit 1970 */
+    const char* daten;         /*!< zeigt in die Aufzeichnung */
+    unsigned int laenge;
+} aufzeichnungStueck;
+
+// Funktionsprototypen
+extern int aufzeichnung_starten(const char* datei);
+extern void aufzeichnung_beenden(void);
+extern void aufzeichnung_anhaengen(const char* daten, unsigned int laenge);
+extern bool aufzeichnung_pruefen(const char* daten, size_t groesse);
+extern bool aufzeichnung_lesen(const char* daten, size_t groesse, size_t* pos, aufzeichnungStueck* s);
+extern size_t aufzeichnung_synchronisieren(const char* daten, size_t groesse, size_t pos);
+
+#endif // AUFZEICHNUNG_H_
@@ -0,0 +1,367 @@
+/**
+ * @file gpsleser.c
+ *
+ * @brief Lesethread für das u-blox NEO-7M GPS-Modul
+ *
+ * Der Ringpuffer kommt mit zwei Zählern aus: Der Lesethread füllt einen
+ * Platz und veröffentlicht ihn danach mit einem Release-Store auf
+ * gpsLeser::schreiben, der Verbraucher liest diesen Zähler mit Acquire
+ * und sieht damit den vollständigen Platz. In der Gegenrichtung gibt der
+ * Verbraucher einen Platz über gpsLeser::lesen zurück. Ist der Ring
+ * voll, wird die neue Lösung verworfen, denn der Lesethread darf den
+ * Lesezähler nicht verändern.
+ *
+ * Der Lesethread hält die Bussperre nur während #ublox_drain, das
+ * Aufzeichnen und Dekodieren läuft ohne Sperre.
+ *
+ * Eine Epoche beginnt, wenn nach mindestens einer halben Periode ohne
+ * Daten wieder Daten kommen. So zerfällt eine Epoche, die über mehrere
+ * Abfragen eintrifft, nicht in mehrere. Der Abstand zweier Epochen geht
+ * mit Gewicht 1/4 in die Periode ein; passt er nicht zur Periode (z.B.
+ * eine ausgefallene Epoche), wird er verworfen. Erst nach
+ * #AUSREISSER_MAX solchen Abständen in Folge gilt die Ausgaberate als
+ * geändert und die Periode wird neu gesetzt.
+ *
+ * Die Hilfsdaten werden beim nächsten Anfordern gespeichert, bis dahin
+ * sind die Antworten auf die vorige Anforderung längst eingetroffen.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+
+#include "i2cusb/i2cusb.h"
+#include "ublox.h"
+#include "gpsleser.h"
+
+#define MS 1000000LL          // ns pro ms
+#define PAUSE_MIN (50 * MS)   // kürzeste Pause vor einer Epoche, solange die Periode unbekannt ist
+#define AUSREISSER_MAX 3
+
+/**
+ * @brief Zeitpunkt in ns
+ */
+static long long nanos(const struct timespec* t) {
+    return (long long) t->tv_sec * 1000000000LL + t->tv_nsec;
+}
+
+/**
+ * @brief Rückruf des Parsers, veröffentlicht eine NAV-PVT-Lösung und
+ *     gibt AID-Nachrichten an die Hilfsdaten weiter
+ */
+static void ubxEmpfangen(unsigned char klasse, unsigned char id, const char* nutzdaten,
+                         unsigned int laenge, void* kontext) {
+    gpsLeser* l = (gpsLeser*) kontext;
+    unsigned int schreiben = l->schreiben;
+    hilfsdaten* h;
+    gpsMeldung* m;
+
+    if(klasse == UBX_AID) {
+        h = __atomic_load_n(&l->hilfe, __ATOMIC_ACQUIRE);
+        if(h != NULL) {
+            hilfsdaten_sammeln(klasse, id, nutzdaten, laenge, h);
+        }
+        return;
+    }
+
+    if(klasse != UBX_NAV || id != UBX_NAV_PVT) {
+        return;
+    }
+
+    // voll: der Verbraucher hat noch nicht abgeholt
+    if(schreiben - __atomic_load_n(&l->lesen, __ATOMIC_ACQUIRE) >= GPSLESER_PLAETZE) {
+        __atomic_fetch_add(&l->verloren, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    m = &l->ring[schreiben % GPSLESER_PLAETZE];
+    if(!ubx_nav_pvt(nutzdaten, laenge, &m->fix)) {
+        return;
+    }
+    m->empfangen = l->stempel;
+    m->frueh = l->frueh;
+
+    __atomic_store_n(&l->schreiben, schreiben + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&l->fixNs, nanos(&l->stempel), __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Den Beginn einer Epoche in die Periode einrechnen
+ */
+static void epocheBeginnt(gpsLeser* l, long long jetzt) {
+    long long periode = l->periodeNs;
+    long long abstand = jetzt - l->epocheNs;
+
+    if(l->epocheNs != 0) {
+        if(periode == 0 || l->ausreisser >= AUSREISSER_MAX) {
+            periode = abstand;
+            l->ausreisser = 0;
+        } else if(abstand > periode / 2 && abstand < periode + periode / 2) {
+            periode += (abstand - periode) / 4;
+            l->ausreisser = 0;
+        } else {
+            l->ausreisser++;
+        }
+        __atomic_store_n(&l->periodeNs, periode, __ATOMIC_RELAXED);
+    }
+
+    l->epocheNs = jetzt;
+}
+
+/**
+ * @brief Wartezeit bis zur nächsten Abfrage bestimmen
+ * @param l Zustand des Lesethreads
+ * @param anzahl Ergebnis der letzten Abfrage
+ * @param voll der Lesepuffer wurde vollständig gefüllt
+ * @param jetzt Zeitpunkt der letzten Abfrage in ns
+ * @return Wartezeit in ns
+ */
+static long long naechsteAbfrage(gpsLeser* l, int anzahl, bool voll, long long jetzt) {
+    long long min = GPSLESER_MIN_INTERVALL * MS;
+    long long max = l->intervall * MS;
+    long long periode = l->periodeNs;
+    long long warte;
+
+    if(max < min) {
+        max = min;
+    }
+
+    if(anzahl > 0) {
+        if(jetzt - l->datenNs > (periode ? periode / 2 : PAUSE_MIN)) {
+            epocheBeginnt(l, jetzt);
+        }
+        l->datenNs = jetzt;
+        l->warteNs = min;
+
+        // der Rest der Epoche liegt vermutlich schon bereit
+        return voll ? 0 : min;
+    }
+
+    // bis kurz vor die erwartete Epoche schlafen
+    if(periode != 0) {
+        warte = l->epocheNs + periode - GPSLESER_VORLAUF * MS - jetzt;
+        if(warte > min) {
+            l->warteNs = min;
+            return warte;
+        }
+    }
+
+    // die Epoche ist fällig oder die Periode unbekannt: Abstand verdoppeln
+    warte = l->warteNs < min ? min : l->warteNs;
+    l->warteNs = warte * 2 > max ? max : warte * 2;
+
+    return warte;
+}
+
+/**
+ * @brief Hilfsdaten speichern und neu anfordern, falls es Zeit dafür ist
+ * @return true, falls angefordert wurde
+ */
+static bool hilfeAnfordern(gpsLeser* l, long long jetzt) {
+    hilfsdaten* h = __atomic_load_n(&l->hilfe, __ATOMIC_ACQUIRE);
+    int ergebnis;
+
+    if(h == NULL || (l->hilfeNs != 0 && jetzt - l->hilfeNs < l->hilfeAbstandNs)) {
+        return false;
+    }
+
+    if(l->hilfeNs != 0) {
+        hilfsdaten_speichern(h, l->hilfeDatei);
+    }
+
+    bus_sperren();
+    ergebnis = hilfsdaten_anfordern();
+    bus_freigeben();
+
+    if(ergebnis < 0) {
+        __atomic_fetch_add(&l->fehler, 1, __ATOMIC_RELAXED);
+    }
+    l->hilfeNs = jetzt;
+
+    return ergebnis == 0;
+}
+
+/**
+ * @brief Schleife des Lesethreads
+ *
+ * Kommt der Puffer voll zurück, liegen im Modul vermutlich noch Daten,
+ * dann wird ohne Pause weitergelesen.
+ */
+static void* lesethread(void* arg) {
+    gpsLeser* l = (gpsLeser*) arg;
+    char puffer[256];
+    struct timespec vorher;
+    struct timespec pause;
+    long long warte;
+    int anzahl;
+
+    while(__atomic_load_n(&l->laeuft, __ATOMIC_ACQUIRE)) {
+        bus_sperren();
+        clock_gettime(CLOCK_MONOTONIC, &vorher);
+        anzahl = ublox_drain(&ubloxStandard, puffer, sizeof(puffer));
+        clock_gettime(CLOCK_MONOTONIC, &l->stempel);
+        bus_freigeben();
+
+        ublox_aufzeichnen(&ubloxStandard, puffer, anzahl);
+
+        __atomic_fetch_add(&l->busNs, nanos(&l->stempel) - nanos(&vorher), __ATOMIC_RELAXED);
+        __atomic_fetch_add(&l->abfragen, 1, __ATOMIC_RELAXED);
+
+        if(anzahl < 0) {
+            __atomic_fetch_add(&l->fehler, 1, __ATOMIC_RELAXED);
+        } else if(anzahl > 0) {
+            ubx_verarbeiten(&l->parser, puffer, anzahl);
+        } else {
+            __atomic_fetch_add(&l->leer, 1, __ATOMIC_RELAXED);
+            l->frueh = vorher;
+        }
+
+        warte = naechsteAbfrage(l, anzahl, anzahl == (int) sizeof(puffer), nanos(&l->stempel));
+
+        // die Antworten bald abholen, bis zu 5 kB passen nicht lange in den Puffer des Moduls
+        if(hilfeAnfordern(l, nanos(&l->stempel)) && warte > GPSLESER_MIN_INTERVALL * MS) {
+            warte = GPSLESER_MIN_INTERVALL * MS;
+        }
+        if(warte > 0) {
+            pause.tv_sec = warte / 1000000000LL;
+            pause.tv_nsec = warte % 1000000000LL;
+            nanosleep(&pause, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Lesethread starten
+ * @param l Zustand des Lesethreads, muss bis #gpsleser_stoppen gültig bleiben
+ * @param intervall größter Abfrageabstand in ms, solange keine Daten
+ *     kommen, 0 für #GPSLESER_INTERVALL
+ * @return 0 bei Erfolg, -1 im Fehlerfall
+ */
+int gpsleser_starten(gpsLeser* l, unsigned int intervall) {
+    struct timespec start;
+    int fehler;
+
+    memset(l, 0, sizeof(*l));
+    l->intervall = intervall ? intervall : GPSLESER_INTERVALL;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    l->startNs = nanos(&start);
+    ubx_parser_init(&l->parser, NULL, ubxEmpfangen, l);
+    l->laeuft = true;
+
+    fehler = pthread_create(&l->faden, NULL, lesethread, l);
+    if(fehler != 0) {
+        fprintf(stderr, "gpsleser_starten: Thread konnte nicht gestartet werden (%s)!\n",
+                strerror(fehler));
+        l->laeuft = false;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Lesethread beenden und auf ihn warten
+ *
+ * Schläft der Thread gerade bis zur nächsten Epoche, dauert das bis zu
+ * einer Periode.
+ *
+ * Noch nicht abgeholte Lösungen bleiben im Ring und können weiter mit
+ * #gpsleser_holen gelesen werden. Mit #gpsleser_hilfsdaten gesammelte
+ * Hilfsdaten werden ein letztes Mal gespeichert.
+ */
+void gpsleser_stoppen(gpsLeser* l) {
+    if(!l->laeuft) {
+        return;
+    }
+    __atomic_store_n(&l->laeuft, false, __ATOMIC_RELEASE);
+    pthread_join(l->faden, NULL);
+
+    if(l->hilfe != NULL && l->hilfeNs != 0) {
+        hilfsdaten_speichern(l->hilfe, l->hilfeDatei);
+    }
+}
+
+/**
+ * @brief Älteste noch nicht abgeholte Lösung entnehmen, blockiert nicht
+ *
+ * Darf nur von einem Thread aus aufgerufen werden.
+ *
+ * @param l Zustand des Lesethreads
+ * @param m Ziel für die Lösung
+ * @return true, falls eine Lösung vorlag
+ */
+bool gpsleser_holen(gpsLeser* l, gpsMeldung* m) {
+    unsigned int lesen = l->lesen;
+
+    if(lesen == __atomic_load_n(&l->schreiben, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    *m = l->ring[lesen % GPSLESER_PLAETZE];
+    __atomic_store_n(&l->lesen, lesen + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/**
+ * @brief Anzahl der verworfenen Lösungen, weil der Ring voll war
+ */
+unsigned long gpsleser_verloren(const gpsLeser* l) {
+    return __atomic_load_n(&l->verloren, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Anzahl der fehlgeschlagenen Abfragen
+ */
+unsigned long gpsleser_fehler(const gpsLeser* l) {
+    return __atomic_load_n(&l->fehler, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Kennzahlen des Lesethreads abfragen
+ *
+ * Die Belegung ist der Anteil der Zeit seit #gpsleser_starten, in dem der
+ * Lesethread den Bus gesperrt hatte. Das Alter der letzten Lösung zählt
+ * ab ihrem Empfang, nicht ab der Epoche im Modul.
+ *
+ * @param l Zustand des Lesethreads
+ * @param m Ziel für die Kennzahlen
+ */
+void gpsleser_metrik(const gpsLeser* l, gpsMetrik* m) {
+    struct timespec jetzt;
+    long long laufzeit;
+    long long fix = __atomic_load_n(&l->fixNs, __ATOMIC_RELAXED);
+
+    clock_gettime(CLOCK_MONOTONIC, &jetzt);
+    laufzeit = nanos(&jetzt) - l->startNs;
+
+    m->belegung = laufzeit > 0 ? (double) __atomic_load_n(&l->busNs, __ATOMIC_RELAXED) / laufzeit : 0.0;
+    m->fixAlter = fix != 0 ? (nanos(&jetzt) - fix) / 1e9 : -1.0;
+    m->periode = __atomic_load_n(&l->periodeNs, __ATOMIC_RELAXED) / 1e6;
+    m->abfragen = __atomic_load_n(&l->abfragen, __ATOMIC_RELAXED);
+    m->leer = __atomic_load_n(&l->leer, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Hilfsdaten im Lesethread sammeln und regelmäßig speichern
+ *
+ * Nach #gpsleser_starten aufrufen. Der Lesethread fordert die
+ * Hilfsdaten sofort und danach alle sekunden Sekunden an und schreibt
+ * vor jeder neuen Anforderung sowie bei #gpsleser_stoppen die bis dahin
+ * gesammelten Daten in die Datei. h gehört bis #gpsleser_stoppen dem
+ * Lesethread. Mit #hilfsdaten_laden vorbelegt, bleiben gespeicherte
+ * Daten erhalten, für die das Modul noch nichts meldet.
+ *
+ * @param l Zustand des Lesethreads
+ * @param h Zwischenspeicher, muss bis #gpsleser_stoppen gültig bleiben
+ * @param datei Datei für #hilfsdaten_speichern
+ * @param sekunden Abstand der Anforderungen
+ */
+void gpsleser_hilfsdaten(gpsLeser* l, hilfsdaten* h, const char* datei, unsigned int sekunden) {
+    l->hilfeDatei = datei;
+    l->hilfeAbstandNs = (long long) sekunden * 1000 * MS;
+    __atomic_store_n(&l->hilfe, h, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,120 @@
+/**
+ * @file gpsleser.h
+ *
+ * @brief Lesethread für das u-blox NEO-7M GPS-Modul
+ *
+ * Ein eigener Thread fragt das Modul mit #drainUblox ab, dekodiert
+ * NAV-PVT und legt jede Lösung zusammen mit der Empfangszeit
+ * (CLOCK_MONOTONIC) in einen Ringpuffer. Der Ringpuffer hat
+ * genau einen Erzeuger (den Lesethread) und einen Verbraucher, beide
+ * Seiten kommen ohne Sperren aus. #gpsleser_holen blockiert nie.
+ *
+ * Der Abfrageabstand passt sich an: Aus den Zeitpunkten, zu denen nach
+ * einer Pause wieder Daten kommen, wird der Abstand der Epochen gelernt.
+ * Nach dem Abholen einer Epoche schläft der Thread bis kurz vor die
+ * nächste, bleibt der Puffer dann leer, wird der Abstand bis zum
+ * übergebenen Höchstwert verdoppelt.
+ *
+ * Das Modul muss NAV-PVT ausgeben, siehe #binaryModeUblox. Greift ein
+ * anderer Thread gleichzeitig auf den Adapter zu (z.B. das Display),
+ * muss er dazu #bus_sperren benutzen.
+ *
+ * gpsMeldung::frueh und gpsMeldung::empfangen grenzen ein, wann eine
+ * Lösung beim Rechner ankam: vor der letzten Abfrage ohne Daten und
+ * nach der Abfrage, die sie vervollständigt hat. Damit richtet
+ * gpszeit.h die Rechneruhr an der GPS-Zeit aus.
+ *
+ * Mit #gpsleser_hilfsdaten fordert der Thread außerdem regelmäßig die
+ * AID-Hilfsdaten an und speichert sie für den nächsten Start.
+ */
+
+#ifndef GPSLESER_H_
+#define GPSLESER_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "ubx.h"
+#include "hilfsdaten.h"
+
+#define GPSLESER_PLAETZE 16      /*!< Plätze im Ringpuffer, Zweierpotenz */
+#define GPSLESER_INTERVALL 100   /*!< Voreinstellung für den größten Abfrageabstand in ms */
+#define GPSLESER_MIN_INTERVALL 10 /*!< kleinster Abfrageabstand in ms */
+#define GPSLESER_VORLAUF 20      /*!< so viele ms vor der erwarteten Epoche wird wieder abgefragt */
+
+/**
+ * @brief Eine Lösung mit ihrer Empfangszeit
+ */
+typedef struct gpsMeldung {
+    ubxFix fix;
+    struct timespec empfangen;   /*!< CLOCK_MONOTONIC nach dem Lesen des letzten Stücks */
+    struct timespec frueh;       /*!< CLOCK_MONOTONIC vor der letzten Abfrage ohne Daten, 0: keine */
+} gpsMeldung;
+
+/**
+ * @brief Kennzahlen eines Lesethreads, siehe #gpsleser_metrik
+ */
+typedef struct gpsMetrik {
+    double belegung;           /*!< Anteil der Laufzeit, in dem der Lesethread den Bus belegt */
+    double fixAlter;           /*!< Sekunden seit dem Empfang der letzten Lösung, negativ: noch keine */
+    double periode;            /*!< gelernter Abstand der Epochen in ms, 0: noch unbekannt */
+    unsigned long abfragen;    /*!< Abfragen insgesamt */
+    unsigned long leer;        /*!< Abfragen ohne Daten */
+} gpsMetrik;
+
+/**
+ * @brief Zustand eines Lesethreads
+ *
+ * Die Felder sind intern. schreiben ändert nur der Lesethread, lesen
+ * nur der Verbraucher; beide laufen frei über und werden erst beim
+ * Zugriff auf den Ring auf die Platzanzahl reduziert. Die Zähler
+ * schreibt der Lesethread, andere Threads lesen sie mit
+ * #gpsleser_verloren und #gpsleser_fehler.
+ */
+typedef struct gpsLeser {
+    gpsMeldung ring[GPSLESER_PLAETZE];
+    unsigned int schreiben;      /*!< Anzahl veröffentlichter Meldungen */
+    unsigned int lesen;          /*!< Anzahl abgeholter Meldungen */
+
+    pthread_t faden;
+    bool laeuft;
+    unsigned int intervall;      /*!< größter Abfrageabstand in ms */
+    ubxParser parser;
+    struct timespec stempel;     /*!< Empfangszeit des gerade verarbeiteten Stücks */
+    struct timespec frueh;       /*!< Beginn der letzten Abfrage ohne Daten */
+
+    // Zeitplan, nur im Lesethread benutzt (Zeiten in ns, CLOCK_MONOTONIC)
+    long long epocheNs;          /*!< Beginn der letzten Epoche */
+    long long datenNs;           /*!< letzte Abfrage mit Daten */
+    long long warteNs;           /*!< nächster Abstand, wenn der Puffer leer bleibt */
+    int ausreisser;              /*!< Epochenabstände in Folge, die nicht zur Periode passen */
+
+    // Kennzahlen, siehe gpsleser_metrik
+    long long startNs;
+    long long periodeNs;
+    long long busNs;             /*!< Summe der Zeit mit gesperrtem Bus */
+    long long fixNs;             /*!< Empfangszeit der letzten Lösung, 0: keine */
+    unsigned long abfragen;
+    unsigned long leer;
+
+    // Hilfsdaten, siehe gpsleser_hilfsdaten
+    hilfsdaten* hilfe;
+    const char* hilfeDatei;
+    long long hilfeAbstandNs;
+    long long hilfeNs;           /*!< letzte Anforderung, 0: noch keine */
+
+    unsigned long verloren;      /*!< Lösungen, die bei vollem Ring verworfen wurden */
+    unsigned long fehler;        /*!< fehlgeschlagene Abfragen */
+} gpsLeser;
+
+// Funktionsprototypen
+extern int gpsleser_starten(gpsLeser* l, unsigned int intervall);
+extern void gpsleser_stoppen(gpsLeser* l);
+extern bool gpsleser_holen(gpsLeser* l, gpsMeldung* m);
+extern unsigned long gpsleser_verloren(const gpsLeser* l);
+extern unsigned long gpsleser_fehler(const gpsLeser* l);
+extern void gpsleser_metrik(const gpsLeser* l, gpsMetrik* m);
+extern void gpsleser_hilfsdaten(gpsLeser* l, hilfsdaten* h, const char* datei, unsigned int sekunden);
+
+#endif // GPSLESER_H_
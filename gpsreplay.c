@@ -0,0 +1,311 @@
+/**
+ * @file gpsreplay.c
+ *
+ * @brief Aufzeichnungen des GPS-Datenstroms erneut durch den Parser schicken
+ *
+ * Aufruf: gpsreplay [-j threads] datei...
+ *
+ * Die Dateien (siehe aufzeichnung.h) werden in den Speicher eingeblendet
+ * und in Abschnitte von #ABSCHNITT Bytes geteilt, die mehrere Threads
+ * parallel verarbeiten. Jeder Abschnitt beginnt am ersten Stückkopf ab
+ * seiner Startposition. Eine Nachricht, die über das Ende eines
+ * Abschnitts reicht, liest dessen Thread byteweise zu Ende; ab dort ist
+ * der nächste Abschnitt zuständig. In gestörten Bereichen direkt an einer
+ * Grenze kann das Ergebnis deshalb um einzelne Nachrichten von einem
+ * Durchlauf in einem Stück abweichen.
+ *
+ * Ausgegeben werden je Datei die Zähler des Parsers und die Anzahl der
+ * NAV-PVT-Lösungen sowie der Gesamtdurchsatz.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#if defined (__WIN32) || defined (_WIN64)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "ubx.h"
+#include "aufzeichnung.h"
+
+#define ABSCHNITT (32UL << 20)   // Größe der parallel verarbeiteten Abschnitte
+#define THREADS_MAX 64
+
+/**
+ * Eine eingeblendete Aufzeichnung und ihre Ergebnisse. Die Zähler
+ * addieren alle Threads, die einen Abschnitt der Datei bearbeiten.
+ */
+typedef struct datei {
+    const char* name;
+    const char* daten;
+    size_t groesse;
+
+    unsigned long stuecke;
+    unsigned long nmea;
+    unsigned long ubx;
+    unsigned long pvt;
+    unsigned long pruefsummen;
+    unsigned long verworfen;
+} datei;
+
+typedef struct abschnitt {
+    datei* d;
+    size_t von;
+    size_t bis;
+} abschnitt;
+
+abschnitt* abschnitte;
+unsigned int anzahlAbschnitte = 0;
+unsigned int naechsterAbschnitt = 0;
+
+/**
+ * @brief Datei nur lesend in den Speicher einblenden
+ * @return Anfang der Daten, NULL im Fehlerfall
+ */
+const char* einblenden(const char* name, size_t* groesse) {
+#if defined (__WIN32) || defined (_WIN64)
+    HANDLE h;
+    HANDLE abbildung;
+    LARGE_INTEGER g;
+    const char* daten;
+
+    h = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                    FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(h == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    if(!GetFileSizeEx(h, &g)) {
+        CloseHandle(h);
+        return NULL;
+    }
+    *groesse = (size_t) g.QuadPart;
+    if(*groesse == 0) {
+        CloseHandle(h);
+        return "";
+    }
+
+    abbildung = CreateFileMappingA(h, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(h);
+    if(abbildung == NULL) {
+        return NULL;
+    }
+    daten = MapViewOfFile(abbildung, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(abbildung);
+
+    return daten;
+#else
+    struct stat st;
+    void* daten;
+    int fd = open(name, O_RDONLY);
+
+    if(fd < 0) {
+        return NULL;
+    }
+    if(fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+    *groesse = (size_t) st.st_size;
+    if(*groesse == 0) {
+        close(fd);
+        return "";
+    }
+
+    daten = mmap(NULL, *groesse, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(daten == MAP_FAILED) {
+        return NULL;
+    }
+    posix_madvise(daten, *groesse, POSIX_MADV_SEQUENTIAL);
+
+    return daten;
+#endif
+}
+
+/**
+ * @brief Anzahl der Prozessorkerne
+ */
+unsigned int kerne(void) {
+#if defined (__WIN32) || defined (_WIN64)
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (unsigned int) n : 1;
+#endif
+}
+
+/**
+ * @brief Rückruf des Parsers, dekodiert NAV-PVT
+ */
+void ubxEmpfangen(unsigned char klasse, unsigned char id, const char* nutzdaten,
+                  unsigned int laenge, void* kontext) {
+    unsigned long* pvt = (unsigned long*) kontext;
+    ubxFix fix;
+
+    if(klasse == UBX_NAV && id == UBX_NAV_PVT && ubx_nav_pvt(nutzdaten, laenge, &fix)) {
+        (*pvt)++;
+    }
+}
+
+/**
+ * @brief Einen Abschnitt verarbeiten und die Zähler zur Datei addieren
+ */
+void abspielen(abschnitt* a) {
+    datei* d = a->d;
+    ubxParser parser;
+    aufzeichnungStueck s;
+    unsigned long stuecke = 0;
+    unsigned long pvt = 0;
+    size_t pos;
+
+    ubx_parser_init(&parser, NULL, ubxEmpfangen, &pvt);
+
+    pos = aufzeichnung_synchronisieren(d->daten, d->groesse, a->von);
+    while(pos < a->bis && aufzeichnung_lesen(d->daten, d->groesse, &pos, &s)) {
+        ubx_verarbeiten(&parser, s.daten, s.laenge);
+        stuecke++;
+    }
+
+    // über die Grenze reichende Nachricht byteweise zu Ende lesen, damit
+    // keine im nächsten Abschnitt beginnende doppelt gezählt wird
+    while(ubx_in_nachricht(&parser) && aufzeichnung_lesen(d->daten, d->groesse, &pos, &s)) {
+        for(unsigned int i = 0; i < s.laenge && ubx_in_nachricht(&parser); i++) {
+            ubx_verarbeiten(&parser, s.daten + i, 1);
+        }
+    }
+
+    __atomic_fetch_add(&d->stuecke, stuecke, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&d->nmea, parser.nmeaSaetze, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&d->ubx, parser.ubxNachrichten, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&d->pvt, pvt, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&d->pruefsummen, parser.pruefsummen, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&d->verworfen, parser.verworfen, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Arbeitsthread, holt sich Abschnitte, bis keine mehr übrig sind
+ */
+void* arbeiten(void* arg) {
+    unsigned int k;
+
+    (void) arg;
+    while((k = __atomic_fetch_add(&naechsterAbschnitt, 1, __ATOMIC_RELAXED)) < anzahlAbschnitte) {
+        abspielen(&abschnitte[k]);
+    }
+
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    datei* dateien;
+    pthread_t threads[THREADS_MAX];
+    unsigned int anzahlThreads = kerne();
+    int anzahlDateien = 0;
+    size_t gesamt = 0;
+    struct timespec start;
+    struct timespec ende;
+    double sekunden;
+    int i = 1;
+
+    if(argc > 2 && strcmp(argv[1], "-j") == 0) {
+        anzahlThreads = (unsigned int) atoi(argv[2]);
+        i = 3;
+    }
+    if(anzahlThreads < 1) {
+        anzahlThreads = 1;
+    }
+    if(anzahlThreads > THREADS_MAX) {
+        anzahlThreads = THREADS_MAX;
+    }
+    if(i >= argc) {
+        fprintf(stderr, "Aufruf: %s [-j threads] datei...\n", argv[0]);
+        return 1;
+    }
+
+    dateien = calloc(argc - i, sizeof(datei));
+    abschnitte = calloc(1, sizeof(abschnitt));
+    if(dateien == NULL || abschnitte == NULL) {
+        fprintf(stderr, "gpsreplay: Kein Speicher!\n");
+        return 1;
+    }
+
+    // Dateien einblenden und in Abschnitte teilen
+    for(; i < argc; i++) {
+        datei* d = &dateien[anzahlDateien];
+        unsigned int teile;
+
+        d->name = argv[i];
+        d->daten = einblenden(d->name, &d->groesse);
+        if(d->daten == NULL) {
+            fprintf(stderr, "gpsreplay: %s konnte nicht geöffnet werden!\n", d->name);
+            continue;
+        }
+        if(!aufzeichnung_pruefen(d->daten, d->groesse)) {
+            fprintf(stderr, "gpsreplay: %s ist keine Aufzeichnung!\n", d->name);
+            continue;
+        }
+        anzahlDateien++;
+        gesamt += d->groesse;
+
+        teile = (unsigned int) ((d->groesse + ABSCHNITT - 1) / ABSCHNITT);
+        abschnitte = realloc(abschnitte, (anzahlAbschnitte + teile) * sizeof(abschnitt));
+        if(abschnitte == NULL) {
+            fprintf(stderr, "gpsreplay: Kein Speicher!\n");
+            return 1;
+        }
+        for(unsigned int t = 0; t < teile; t++) {
+            abschnitt* a = &abschnitte[anzahlAbschnitte++];
+            a->d = d;
+            a->von = t * ABSCHNITT;
+            a->bis = (t + 1 == teile) ? d->groesse : (t + 1) * ABSCHNITT;
+        }
+    }
+
+    if(anzahlThreads > anzahlAbschnitte) {
+        anzahlThreads = anzahlAbschnitte > 0 ? anzahlAbschnitte : 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(unsigned int t = 0; t < anzahlThreads; t++) {
+        if(pthread_create(&threads[t], NULL, arbeiten, NULL) != 0) {
+            fprintf(stderr, "gpsreplay: Thread konnte nicht gestartet werden!\n");
+            anzahlThreads = t;
+            break;
+        }
+    }
+    // ohne einen einzigen Thread im Hauptthread abspielen
+    if(anzahlThreads == 0) {
+        arbeiten(NULL);
+    }
+    for(unsigned int t = 0; t < anzahlThreads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ende);
+
+    for(int k = 0; k < anzahlDateien; k++) {
+        datei* d = &dateien[k];
+        printf("%s: %zu Bytes, %lu Stücke, NMEA %lu, UBX %lu (NAV-PVT %lu), Prüfsummen %lu, verworfen %lu\n",
+               d->name, d->groesse, d->stuecke, d->nmea, d->ubx, d->pvt, d->pruefsummen, d->verworfen);
+    }
+
+    sekunden = (ende.tv_sec - start.tv_sec) + (ende.tv_nsec - start.tv_nsec) * 1e-9;
+    printf("%d Dateien, %.1f MB in %.3f s mit %u Threads: %.0f MB/s\n", anzahlDateien, gesamt / 1e6,
+           sekunden, anzahlThreads, sekunden > 0 ? gesamt / 1e6 / sekunden : 0.0);
+
+    return 0;
+}
@@ -0,0 +1,320 @@
+/**
+ * @file gpszeit.c
+ *
+ * @brief Rechneruhr an der GPS-Zeit ausrichten
+ *
+ * Jede Probe legt den Versatz zu ihrem Zeitpunkt auf ein Intervall fest
+ * (Mitte ± halbe Breite). Versatz und Drift ergeben sich durch eine
+ * gewichtete lineare Regression über alle Proben, Gewicht 1/Breite²;
+ * schmale Fenster (die Abfrage kam kurz vor den Daten) zählen also
+ * deutlich mehr. Damit die Drift über eine lange Zeit gemessen wird,
+ * bleibt je #GPSZEIT_FACH Sekunden nur die schmalste Probe erhalten.
+ *
+ * Für die Drift wird vorab 0 mit einer Unsicherheit von
+ * #GPSZEIT_DRIFT_MAX angenommen, mit wachsendem Abstand der Proben
+ * überwiegt die Messung.
+ *
+ * Die Fehlerschranke eines umgerechneten Zeitpunkts ist der Schnitt der
+ * Intervalle aller Proben, jeweils mit der geschätzten Drift bis zu
+ * diesem Zeitpunkt fortgeschrieben und um die Unsicherheit der Drift
+ * (drei Standardabweichungen) verbreitert. Der Schätzwert der Regression
+ * wird in diesen Schnitt gelegt, der Fehler ist der Abstand zu dessen
+ * weiterem Rand.
+ *
+ * Ist der Schnitt bei einer neuen Probe leer, passen die Proben nicht
+ * zusammen, etwa nach einer Schaltsekunde oder einem Sprung der
+ * Modulzeit. Dann wird mit der neuen Probe von vorn begonnen.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <string.h>
+
+#include "i2cusb/i2cusb.h"
+#include "gpszeit.h"
+
+#define MS 1000000LL          // ns pro ms
+#define SEKUNDE 1000000000LL  // ns pro s
+#define TAG 86400LL           // s pro Tag
+
+/**
+ * @brief Zeitpunkt in ns
+ */
+static long long nanos(const struct timespec* t) {
+    return (long long) t->tv_sec * SEKUNDE + t->tv_nsec;
+}
+
+/**
+ * @brief Tage seit dem 1.1.1970 (gregorianischer Kalender)
+ */
+static long long tageSeit1970(int jahr, int monat, int tag) {
+    long long era;
+    int jahrDerEra;
+    int tagDesJahres;
+
+    // das Jahr beginnt für die Rechnung im März, der Schalttag liegt am Ende
+    jahr -= monat <= 2;
+    era = (jahr >= 0 ? jahr : jahr - 399) / 400;
+    jahrDerEra = jahr - era * 400;
+    tagDesJahres = (153 * (monat + (monat > 2 ? -3 : 9)) + 2) / 5 + tag - 1;
+
+    return era * 146097 + jahrDerEra * 365 + jahrDerEra / 4 - jahrDerEra / 100 + tagDesJahres - 719468;
+}
+
+/**
+ * @brief Probe aus einer Lösung bilden
+ * @return false, falls Zeit oder Datum ungültig sind oder vor der
+ *     Lösung noch keine Abfrage ohne Daten lag
+ */
+static bool probeBilden(const gpszeit* z, const gpsMeldung* m, gpsZeitprobe* p) {
+    const ubxFix* f = &m->fix;
+    long long frueh = nanos(&m->frueh);
+    long long spaet = nanos(&m->empfangen);
+    long long utc;
+
+    if(!f->zeitGueltig || !f->datumGueltig || frueh == 0 || spaet < frueh) {
+        return false;
+    }
+
+    frueh -= z->adapterNs;
+    utc = (tageSeit1970(f->jahr, f->monat, f->tag) * TAG
+           + f->stunde * 3600LL + f->minute * 60LL + f->sekunde) * SEKUNDE + f->nano;
+
+    p->rechnerNs = frueh + (spaet - frueh) / 2 - z->verzugNs;
+    p->versatzNs = utc - p->rechnerNs;
+    p->breiteNs = (spaet - frueh) / 2 + z->toleranzNs + (long long) f->zeitGenauigkeit + 1;
+
+    return true;
+}
+
+/**
+ * @brief Versatz und Drift aus den Proben neu berechnen
+ */
+static void modellRechnen(gpszeit* z) {
+    const gpsZeitprobe* neueste = &z->proben[(z->naechste + GPSZEIT_FAECHER - 1) % GPSZEIT_FAECHER];
+    double summe = 0.0;
+    double xMittel = 0.0;
+    double yMittel = 0.0;
+    double sxx = 0.0;
+    double sxy = 0.0;
+
+    z->bezugNs = neueste->rechnerNs;
+    z->basisNs = neueste->versatzNs;
+
+    for(unsigned int i = 0; i < z->anzahl; i++) {
+        const gpsZeitprobe* p = &z->proben[i];
+        double g = 1.0 / ((double) p->breiteNs * p->breiteNs);
+
+        summe += g;
+        xMittel += g * (p->rechnerNs - z->bezugNs);
+        yMittel += g * (p->versatzNs - z->basisNs);
+    }
+    xMittel /= summe;
+    yMittel /= summe;
+
+    for(unsigned int i = 0; i < z->anzahl; i++) {
+        const gpsZeitprobe* p = &z->proben[i];
+        double g = 1.0 / ((double) p->breiteNs * p->breiteNs);
+        double x = (p->rechnerNs - z->bezugNs) - xMittel;
+
+        sxx += g * x * x;
+        sxy += g * x * ((p->versatzNs - z->basisNs) - yMittel);
+    }
+
+    // gleichverteilt im Fenster: Varianz Breite²/3, also Gewicht 3/Breite²;
+    // dazu die Annahme Drift 0 mit drei Standardabweichungen von
+    // GPSZEIT_DRIFT_MAX, damit wenige Proben keine wilde Drift ergeben
+    sxx = 3.0 * sxx + 9.0 / (GPSZEIT_DRIFT_MAX * GPSZEIT_DRIFT_MAX);
+    sxy = 3.0 * sxy;
+    z->drift = sxy / sxx;
+    z->driftFehler = 3.0 / sqrt(sxx);
+
+    z->versatz = yMittel - z->drift * xMittel;
+}
+
+/**
+ * @brief Schnitt der fortgeschriebenen Intervalle aller Proben
+ * @param z Zustand des Schätzers
+ * @param t Zeitpunkt in CLOCK_MONOTONIC
+ * @param unten untere Grenze des Versatzes, relativ zu basisNs
+ * @param oben obere Grenze des Versatzes, relativ zu basisNs
+ * @return false, falls der Schnitt leer ist
+ */
+static bool schnitt(const gpszeit* z, long long t, double* unten, double* oben) {
+    *unten = -INFINITY;
+    *oben = INFINITY;
+
+    for(unsigned int i = 0; i < z->anzahl; i++) {
+        const gpsZeitprobe* p = &z->proben[i];
+        double abstand = (double) (t - p->rechnerNs);
+        double mitte = (p->versatzNs - z->basisNs) + z->drift * abstand;
+        double breite = p->breiteNs + z->driftFehler * fabs(abstand);
+
+        if(mitte - breite > *unten) {
+            *unten = mitte - breite;
+        }
+        if(mitte + breite < *oben) {
+            *oben = mitte + breite;
+        }
+    }
+
+    return *unten <= *oben;
+}
+
+/**
+ * @brief Schätzer initialisieren
+ *
+ * Ob der Adapter das Modul im Hintergrund abfragt, wird hier festgestellt,
+ * der Adapter muss also schon initialisiert sein (#Init).
+ *
+ * @param z Zustand des Schätzers
+ * @param verzug Zeit in ms, die das Modul nach der Epoche bis zur
+ *     Ausgabe von NAV-PVT braucht
+ * @param toleranz Toleranz des Verzugs in ms
+ */
+void gpszeit_init(gpszeit* z, unsigned int verzug, unsigned int toleranz) {
+    memset(z, 0, sizeof(*z));
+    pthread_mutex_init(&z->sperre, NULL);
+    z->verzugNs = verzug * MS;
+    z->toleranzNs = toleranz * MS;
+    z->adapterNs = adapter_kann(FAEHIG_UBLOX) ? GPSZEIT_ADAPTER_VERZUG * MS : 0;
+    z->driftFehler = GPSZEIT_DRIFT_MAX;
+}
+
+/**
+ * @brief Lösung des GPS-Lesethreads in die Schätzung aufnehmen
+ *
+ * Im selben Fach wird die neue Probe nur übernommen, wenn ihr Fenster
+ * nicht breiter ist als das der vorhandenen.
+ *
+ * @param z Zustand des Schätzers
+ * @param m Lösung mit Empfangszeit, siehe #gpsleser_holen
+ * @return true, falls die Lösung eine gültige Zeit enthielt
+ */
+bool gpszeit_hinzufuegen(gpszeit* z, const gpsMeldung* m) {
+    gpsZeitprobe p;
+    gpsZeitprobe* neueste;
+    double unten;
+    double oben;
+
+    if(!probeBilden(z, m, &p)) {
+        return false;
+    }
+
+    pthread_mutex_lock(&z->sperre);
+
+    neueste = &z->proben[(z->naechste + GPSZEIT_FAECHER - 1) % GPSZEIT_FAECHER];
+    if(z->anzahl > 0 && p.rechnerNs / (GPSZEIT_FACH * SEKUNDE) == neueste->rechnerNs / (GPSZEIT_FACH * SEKUNDE)) {
+        if(p.breiteNs > neueste->breiteNs) {
+            pthread_mutex_unlock(&z->sperre);
+            return true;
+        }
+        *neueste = p;
+    } else {
+        z->proben[z->naechste] = p;
+        z->naechste = (z->naechste + 1) % GPSZEIT_FAECHER;
+        if(z->anzahl < GPSZEIT_FAECHER) {
+            z->anzahl++;
+        }
+    }
+    modellRechnen(z);
+
+    // widersprüchlich: mit der neuen Probe neu beginnen
+    if(!schnitt(z, p.rechnerNs, &unten, &oben)) {
+        z->proben[0] = p;
+        z->anzahl = 1;
+        z->naechste = 1;
+        z->verworfen++;
+        modellRechnen(z);
+    }
+
+    pthread_mutex_unlock(&z->sperre);
+
+    return true;
+}
+
+/**
+ * @brief Zeitstempel der Rechneruhr in UTC umrechnen
+ *
+ * Darf aus beliebigen Threads aufgerufen werden.
+ *
+ * @param z Zustand des Schätzers
+ * @param monoton Zeitpunkt in CLOCK_MONOTONIC
+ * @param utc Ziel für den Zeitpunkt in UTC (Sekunden seit 1970)
+ * @param fehler Ziel für die Fehlerschranke in s, oder NULL
+ * @return false, solange noch keine Probe vorliegt
+ */
+bool gpszeit_umrechnen(gpszeit* z, const struct timespec* monoton, struct timespec* utc,
+                       double* fehler) {
+    long long t = nanos(monoton);
+    long long ergebnis;
+    double schaetzung;
+    double unten;
+    double oben;
+
+    pthread_mutex_lock(&z->sperre);
+
+    if(z->anzahl == 0) {
+        pthread_mutex_unlock(&z->sperre);
+        return false;
+    }
+
+    schaetzung = z->versatz + z->drift * (double) (t - z->bezugNs);
+
+    // weit weg von den Proben kann der Schnitt leer werden, dann gilt
+    // nur die neueste
+    if(!schnitt(z, t, &unten, &oben)) {
+        const gpsZeitprobe* neueste = &z->proben[(z->naechste + GPSZEIT_FAECHER - 1) % GPSZEIT_FAECHER];
+        double abstand = fabs((double) (t - neueste->rechnerNs));
+
+        schaetzung = z->drift * (double) (t - neueste->rechnerNs);
+        unten = schaetzung - neueste->breiteNs - z->driftFehler * abstand;
+        oben = schaetzung + neueste->breiteNs + z->driftFehler * abstand;
+    }
+    if(schaetzung < unten) {
+        schaetzung = unten;
+    } else if(schaetzung > oben) {
+        schaetzung = oben;
+    }
+
+    ergebnis = t + z->basisNs + llround(schaetzung);
+    if(fehler != NULL) {
+        *fehler = (schaetzung - unten > oben - schaetzung ? schaetzung - unten : oben - schaetzung) / SEKUNDE;
+    }
+
+    pthread_mutex_unlock(&z->sperre);
+
+    utc->tv_sec = ergebnis / SEKUNDE;
+    utc->tv_nsec = ergebnis % SEKUNDE;
+
+    return true;
+}
+
+/**
+ * @brief Aktuelle Zeit in UTC nach der GPS-Schätzung
+ * @param z Zustand des Schätzers
+ * @param utc Ziel für die Zeit (Sekunden seit 1970)
+ * @param fehler Ziel für die Fehlerschranke in s, oder NULL
+ * @return false, solange noch keine Probe vorliegt
+ * @see gpszeit_umrechnen
+ */
+bool gps_now(gpszeit* z, struct timespec* utc, double* fehler) {
+    struct timespec jetzt;
+
+    clock_gettime(CLOCK_MONOTONIC, &jetzt);
+    return gpszeit_umrechnen(z, &jetzt, utc, fehler);
+}
+
+/**
+ * @brief Anzahl der Neuanfänge, weil Proben einander widersprachen
+ */
+unsigned long gpszeit_verworfen(gpszeit* z) {
+    unsigned long verworfen;
+
+    pthread_mutex_lock(&z->sperre);
+    verworfen = z->verworfen;
+    pthread_mutex_unlock(&z->sperre);
+
+    return verworfen;
+}
@@ -0,0 +1,100 @@
+/**
+ * @file gpszeit.h
+ *
+ * @brief Rechneruhr an der GPS-Zeit ausrichten
+ *
+ * Aus den Lösungen des GPS-Lesethreads (#gpsleser_holen) wird geschätzt,
+ * wie die UTC-Zeit der Epochen mit CLOCK_MONOTONIC des Rechners
+ * zusammenhängt: ein Versatz und eine Drift (Gangabweichung der
+ * Rechneruhr). Damit lassen sich eigene Zeitstempel (CLOCK_MONOTONIC) in
+ * UTC umrechnen, jeweils mit einer Fehlerschranke.
+ *
+ * Jede Lösung bringt ein Zeitfenster mit: Die Daten waren zu Beginn der
+ * letzten Abfrage ohne Daten noch nicht da und am Ende der Abfrage, die
+ * die Lösung vervollständigt hat, schon. Die Latenz von Bus und
+ * serieller Schnittstelle steckt damit in jedem einzelnen Fenster und
+ * muss nicht als Ganzes auf den Fehler geschlagen werden. Fragt der
+ * Adapter das Modul im Hintergrund ab, wird das Fenster um
+ * #GPSZEIT_ADAPTER_VERZUG nach vorn verlängert.
+ *
+ * Nicht messbar ist die Zeit, die das Modul nach der Epoche für die
+ * Berechnung braucht, bevor es NAV-PVT ausgibt. Sie wird bei
+ * #gpszeit_init als Verzug mit Toleranz angegeben, z.B. einmal mit dem
+ * PPS-Ausgang des Moduls ausgemessen.
+ *
+ * Beispiel:
+ * @code
+ * gpszeit zeit;
+ * struct timespec utc;
+ * double fehler;
+ * gpszeit_init(&zeit, 0, 0);
+ * while(gpsleser_holen(&leser, &meldung)) {
+ *     gpszeit_hinzufuegen(&zeit, &meldung);
+ * }
+ * if(gps_now(&zeit, &utc, &fehler)) {
+ *     printf("%ld.%09ld +- %.3f ms\n", (long) utc.tv_sec, utc.tv_nsec, fehler * 1e3);
+ * }
+ * @endcode
+ */
+
+#ifndef GPSZEIT_H_
+#define GPSZEIT_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "gpsleser.h"
+
+#define GPSZEIT_FAECHER 64          /*!< gespeicherte Proben, eine je Fach */
+#define GPSZEIT_FACH 16             /*!< Länge eines Fachs in s, es bleibt die genaueste Probe */
+#define GPSZEIT_ADAPTER_VERZUG 30   /*!< so viele ms kann die Abfrage im Hintergrund (I2C-Micro) nachhängen */
+#define GPSZEIT_DRIFT_MAX 500e-6    /*!< größte angenommene Drift der Rechneruhr (Regelgrenze von NTP) */
+
+/**
+ * @brief Eine Probe: Versatz GPS-Zeit minus Rechneruhr zu einem Zeitpunkt
+ */
+typedef struct gpsZeitprobe {
+    long long rechnerNs;         /*!< Epoche in CLOCK_MONOTONIC, Mitte des Fensters */
+    long long versatzNs;         /*!< UTC minus CLOCK_MONOTONIC */
+    long long breiteNs;          /*!< halbe Breite des Fensters einschließlich aller Toleranzen */
+} gpsZeitprobe;
+
+/**
+ * @brief Zustand des Schätzers
+ *
+ * Die Felder sind intern und durch sperre geschützt. Die Proben liegen
+ * in einem Ring, die neueste auf dem Platz vor naechste. Das Modell
+ * wird nach jeder Probe neu berechnet: versatz gilt bei bezugNs, relativ
+ * zum Versatz der neuesten Probe (basisNs), damit die Rechnung in
+ * double genau bleibt.
+ */
+typedef struct gpszeit {
+    pthread_mutex_t sperre;
+    gpsZeitprobe proben[GPSZEIT_FAECHER];
+    unsigned int anzahl;
+    unsigned int naechste;
+
+    long long verzugNs;          /*!< Ausgabeverzug des Moduls nach der Epoche */
+    long long toleranzNs;        /*!< Toleranz des Ausgabeverzugs */
+    long long adapterNs;         /*!< Nachhängen der Abfrage im Hintergrund, 0 ohne */
+
+    // Modell
+    long long bezugNs;
+    long long basisNs;
+    double versatz;              /*!< in ns bei bezugNs, zuzüglich basisNs */
+    double drift;                /*!< ns pro ns */
+    double driftFehler;
+
+    unsigned long verworfen;     /*!< Neuanfänge, weil Proben einander widersprachen */
+} gpszeit;
+
+// Funktionsprototypen
+extern void gpszeit_init(gpszeit* z, unsigned int verzug, unsigned int toleranz);
+extern bool gpszeit_hinzufuegen(gpszeit* z, const gpsMeldung* m);
+extern bool gpszeit_umrechnen(gpszeit* z, const struct timespec* monoton, struct timespec* utc,
+                              double* fehler);
+extern bool gps_now(gpszeit* z, struct timespec* utc, double* fehler);
+extern unsigned long gpszeit_verworfen(gpszeit* z);
+
+#endif // GPSZEIT_H_
@@ -0,0 +1,412 @@
+/**
+ * @file hilfsdaten.c
+ *
+ * @brief Zwischenspeicher für die AID-Hilfsdaten des u-blox NEO-7M GPS-Moduls
+ *
+ * Die Datei besteht aus der Kennung #KENNUNG, dem Inhalt von #hilfsdaten
+ * und einer Prüfsumme (FNV-1a). Sie wird unter einem anderen Namen
+ * geschrieben und erst danach umbenannt, damit ein Stromausfall während
+ * des Speicherns die alte Datei nicht zerstört.
+ *
+ * Beim Hochladen wird die Zeit in AID-INI durch die aktuelle Zeit der
+ * Rechneruhr ersetzt, die gespeicherte wäre längst veraltet. Geht die
+ * Rechneruhr offensichtlich falsch (vor der Empfangszeit der Daten),
+ * werden weder Zeit noch Ephemeriden oder Almanach hochgeladen, denn ihr
+ * Alter lässt sich dann nicht prüfen.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined (__WIN32) || defined (_WIN64)
+#include <windows.h>
+#endif
+
+#include "i2cusb/i2cusb.h"
+#include "ublox.h"
+#include "hilfsdaten.h"
+
+#define KENNUNG "GPSHLF01"
+#define KENNUNG_LAENGE 8
+
+// Bits in den flags von AID-INI
+#define INI_POS 0x001
+#define INI_ZEIT 0x002
+#define INI_DRIFT 0x004
+#define INI_FREQ 0x010
+#define INI_LLA 0x020
+#define INI_ALTINV 0x040
+
+#define SEKUNDE 1000000LL       // µs pro s
+#define GPS_EPOCHE 315964800LL  // 6.1.1980 in s seit 1970
+#define WOCHE 604800LL          // s pro Woche
+
+/**
+ * @brief Interne Funktion, aktuelle Zeit der Rechneruhr in µs seit 1970
+ */
+static long long uhrzeit(void) {
+    struct timespec jetzt;
+
+    clock_gettime(CLOCK_REALTIME, &jetzt);
+    return (long long) jetzt.tv_sec * SEKUNDE + jetzt.tv_nsec / 1000;
+}
+
+/**
+ * @brief Interne Funktion, vorzeichenlose 32-Bit-Zahl Little-Endian lesen
+ */
+static unsigned long leseU4(const char* d) {
+    return (unsigned long) (unsigned char) d[0]
+            | ((unsigned long) (unsigned char) d[1] << 8)
+            | ((unsigned long) (unsigned char) d[2] << 16)
+            | ((unsigned long) (unsigned char) d[3] << 24);
+}
+
+/**
+ * @brief Interne Funktion, Zahl Little-Endian mit der angegebenen Bytezahl schreiben
+ */
+static void schreibe(char* d, unsigned long wert, int bytes) {
+    for(int i = 0; i < bytes; i++) {
+        d[i] = (char) ((wert >> (8*i)) & 0xFF);
+    }
+}
+
+/**
+ * @brief Interne Funktion, Prüfsumme (FNV-1a, 32 Bit)
+ */
+static unsigned long pruefsumme(const void* daten, size_t laenge) {
+    const unsigned char* d = (const unsigned char*) daten;
+    unsigned long summe = 2166136261UL;
+
+    for(size_t i = 0; i < laenge; i++) {
+        summe = ((summe ^ d[i]) * 16777619UL) & 0xFFFFFFFFUL;
+    }
+    return summe;
+}
+
+/**
+ * @brief Interne Funktion, eine UBX-Nachricht mit writeUblox senden
+ */
+static int senden(unsigned char klasse, unsigned char id, const char* nutzdaten, unsigned int laenge) {
+    char nachricht[UBX_KOPF + UBX_AID_EPH_LAENGE + 2];
+
+    laenge = ubx_bauen(nachricht, klasse, id, nutzdaten, laenge);
+    return writeUblox(nachricht, laenge);
+}
+
+/**
+ * @brief Leeren Zwischenspeicher anlegen
+ */
+void hilfsdaten_init(hilfsdaten* h) {
+    memset(h, 0, sizeof(*h));
+}
+
+/**
+ * @brief Rückruf für den Parser, übernimmt AID-INI, AID-ALM und AID-EPH
+ *
+ * Kann direkt an #ubx_parser_init übergeben oder aus einem eigenen
+ * UBX-Rückruf aufgerufen werden, andere Nachrichten werden ignoriert.
+ *
+ * @param kontext Zeiger auf #hilfsdaten
+ */
+void hilfsdaten_sammeln(unsigned char klasse, unsigned char id, const char* nutzdaten,
+                        unsigned int laenge, void* kontext) {
+    hilfsdaten* h = (hilfsdaten*) kontext;
+    unsigned long sv;
+
+    if(klasse != UBX_AID) {
+        return;
+    }
+
+    if(id == UBX_AID_INI && laenge == UBX_AID_INI_LAENGE) {
+        memcpy(h->ini, nutzdaten, laenge);
+        h->iniZeit = uhrzeit();
+        h->antworten++;
+        return;
+    }
+
+    if((id != UBX_AID_ALM && id != UBX_AID_EPH) || laenge < 8) {
+        return;
+    }
+    sv = leseU4(nutzdaten);
+    if(sv < 1 || sv > HILFSDATEN_SATELLITEN) {
+        return;
+    }
+    h->antworten++;
+
+    // nur 8 Bytes: das Modul hat für diesen Satelliten keine Daten
+    if(id == UBX_AID_ALM && laenge == UBX_AID_ALM_LAENGE) {
+        memcpy(h->alm[sv-1], nutzdaten, laenge);
+        h->almZeit[sv-1] = uhrzeit();
+    } else if(id == UBX_AID_EPH && laenge == UBX_AID_EPH_LAENGE) {
+        memcpy(h->eph[sv-1], nutzdaten, laenge);
+        h->ephZeit[sv-1] = uhrzeit();
+    }
+}
+
+/**
+ * @brief AID-INI, AID-EPH und AID-ALM beim Modul anfordern
+ *
+ * Die Antworten kommen im Datenstrom und müssen von dort an
+ * #hilfsdaten_sammeln gehen, zusammen bis zu 65 Nachrichten.
+ *
+ * @return 0 bei Erfolg, -1 im Fehlerfall
+ */
+int hilfsdaten_anfordern(void) {
+    if(senden(UBX_AID, UBX_AID_INI, NULL, 0) == -1
+            || senden(UBX_AID, UBX_AID_EPH, NULL, 0) == -1
+            || senden(UBX_AID, UBX_AID_ALM, NULL, 0) == -1) {
+        fprintf(stderr, "hilfsdaten_anfordern: Abfrage konnte nicht gesendet werden!\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Hilfsdaten abfragen und auf die Antworten warten
+ *
+ * Die drei Nachrichten werden nacheinander abgefragt, damit die bis zu
+ * 3,6 kB Ephemeriden und der Almanach nicht gleichzeitig im Puffer des
+ * Moduls liegen. Nicht für den Betrieb mit dem GPS-Lesethread, der liest
+ * die Antworten selbst (siehe #gpsleser_hilfsdaten).
+ *
+ * @param h Zwischenspeicher
+ * @param weiter Parser für die übrigen Daten, NULL falls nicht benötigt
+ * @return Anzahl der fehlenden Antworten (0 bei Erfolg), -1 im Fehlerfall
+ */
+int hilfsdaten_abfragen(hilfsdaten* h, ubxParser* weiter) {
+    const unsigned char ids[3] = {UBX_AID_INI, UBX_AID_EPH, UBX_AID_ALM};
+    const unsigned int erwartet[3] = {1, HILFSDATEN_SATELLITEN, HILFSDATEN_SATELLITEN};
+    char puffer[256];
+    ubxParser parser;
+    int fehlend = 0;
+
+    ubx_parser_init(&parser, NULL, hilfsdaten_sammeln, h);
+
+    for(int i = 0; i < 3; i++) {
+        unsigned int ziel = h->antworten + erwartet[i];
+
+        if(senden(UBX_AID, ids[i], NULL, 0) == -1) {
+            fprintf(stderr, "hilfsdaten_abfragen: Abfrage konnte nicht gesendet werden!\n");
+            return -1;
+        }
+
+        for(int t = 0; t < HILFSDATEN_TIMEOUT && h->antworten < ziel; t += UBLOX_ACK_INTERVALL) {
+            int n = drainUblox(puffer, sizeof(puffer));
+            if(n < 0) {
+                return -1;
+            }
+            ubx_verarbeiten(&parser, puffer, n);
+            if(weiter) {
+                ubx_verarbeiten(weiter, puffer, n);
+            }
+            if(n < (int) sizeof(puffer)) {
+                delay(UBLOX_ACK_INTERVALL);
+            }
+        }
+
+        if(h->antworten < ziel) {
+            fehlend += ziel - h->antworten;
+        }
+    }
+
+    return fehlend;
+}
+
+/**
+ * @brief Zwischenspeicher in eine Datei schreiben
+ *
+ * @param h Zwischenspeicher
+ * @param datei Name der Datei, wird ersetzt
+ * @return 0 bei Erfolg, -1 im Fehlerfall
+ */
+int hilfsdaten_speichern(const hilfsdaten* h, const char* datei) {
+    char neu[FILENAME_MAX];
+    char summe[4];
+    FILE* f;
+
+    if(snprintf(neu, sizeof(neu), "%s.neu", datei) >= (int) sizeof(neu)) {
+        fprintf(stderr, "hilfsdaten_speichern: Dateiname zu lang!\n");
+        return -1;
+    }
+
+    f = fopen(neu, "wb");
+    if(f == NULL) {
+        fprintf(stderr, "hilfsdaten_speichern: %s konnte nicht geöffnet werden!\n", neu);
+        return -1;
+    }
+
+    schreibe(summe, pruefsumme(h, sizeof(*h)), 4);
+    if(fwrite(KENNUNG, 1, KENNUNG_LAENGE, f) != KENNUNG_LAENGE
+            || fwrite(h, sizeof(*h), 1, f) != 1
+            || fwrite(summe, 1, 4, f) != 4) {
+        fprintf(stderr, "hilfsdaten_speichern: Schreiben fehlgeschlagen!\n");
+        fclose(f);
+        remove(neu);
+        return -1;
+    }
+    if(fclose(f) != 0) {
+        fprintf(stderr, "hilfsdaten_speichern: Schreiben fehlgeschlagen!\n");
+        remove(neu);
+        return -1;
+    }
+
+#if defined (__WIN32) || defined (_WIN64)
+    // rename ersetzt unter Windows keine vorhandene Datei, MoveFileEx
+    // ersetzt sie in einem Schritt
+    if(!MoveFileExA(neu, datei, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+#else
+    if(rename(neu, datei) != 0) {
+#endif
+        fprintf(stderr, "hilfsdaten_speichern: %s konnte nicht ersetzt werden!\n", datei);
+        remove(neu);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Zwischenspeicher aus einer Datei lesen
+ *
+ * Fehlt die Datei, ist das nach dem ersten Start normal und wird nicht
+ * gemeldet. h ist danach in jedem Fall gültig, im Fehlerfall leer.
+ *
+ * @param h Zwischenspeicher
+ * @param datei Name der Datei
+ * @return 0 bei Erfolg, -1 falls die Datei fehlt oder ungültig ist
+ */
+int hilfsdaten_laden(hilfsdaten* h, const char* datei) {
+    char kennung[KENNUNG_LAENGE];
+    char summe[4];
+    FILE* f;
+    bool ok;
+
+    hilfsdaten_init(h);
+
+    f = fopen(datei, "rb");
+    if(f == NULL) {
+        return -1;
+    }
+
+    ok = fread(kennung, 1, KENNUNG_LAENGE, f) == KENNUNG_LAENGE
+            && memcmp(kennung, KENNUNG, KENNUNG_LAENGE) == 0
+            && fread(h, sizeof(*h), 1, f) == 1
+            && fread(summe, 1, 4, f) == 4
+            && fgetc(f) == EOF
+            && leseU4(summe) == pruefsumme(h, sizeof(*h));
+    fclose(f);
+
+    if(!ok) {
+        fprintf(stderr, "hilfsdaten_laden: %s ist ungültig und wird ignoriert!\n", datei);
+        hilfsdaten_init(h);
+        return -1;
+    }
+
+    h->antworten = 0;
+    return 0;
+}
+
+/**
+ * @brief Gespeicherte Hilfsdaten prüfen und zum Modul hochladen
+ *
+ * Direkt nach #Init aufrufen. Zuerst geht AID-INI mit der gespeicherten
+ * Position und der aktuellen Zeit raus, danach alle Ephemeriden jünger
+ * als #HILFSDATEN_EPH_ALTER und alle Almanachdaten jünger als
+ * #HILFSDATEN_ALM_ALTER. Ist auch die Position älter als
+ * #HILFSDATEN_EPH_ALTER, wird ihre Genauigkeit auf
+ * #HILFSDATEN_POS_GENAUIGKEIT vergrößert und die Uhrendrift weggelassen.
+ *
+ * @param datei mit #hilfsdaten_speichern geschriebene Datei
+ * @return Anzahl der hochgeladenen Nachrichten, -1 im Fehlerfall
+ */
+int hilfsdaten_hochladen(const char* datei) {
+    hilfsdaten h;
+    char ini[UBX_AID_INI_LAENGE];
+    long long jetzt = uhrzeit();
+    long long neueste;
+    unsigned long flags = 0;
+    bool uhrOk;
+    int gesendet = 0;
+
+    if(hilfsdaten_laden(&h, datei) == -1) {
+        return 0;
+    }
+
+    // die Rechneruhr darf nicht (mehr als ihre Genauigkeit) vor der Empfangszeit der Daten stehen
+    neueste = h.iniZeit;
+    for(int i = 0; i < HILFSDATEN_SATELLITEN; i++) {
+        if(h.ephZeit[i] > neueste) {
+            neueste = h.ephZeit[i];
+        }
+        if(h.almZeit[i] > neueste) {
+            neueste = h.almZeit[i];
+        }
+    }
+    uhrOk = jetzt + HILFSDATEN_ZEITGENAUIGKEIT * 1000LL >= neueste;
+    if(!uhrOk) {
+        fprintf(stderr, "hilfsdaten_hochladen: Rechneruhr steht vor den gespeicherten Daten, nur die Position wird hochgeladen!\n");
+    }
+
+    // AID-INI: gespeicherte Position und Drift, aktuelle Zeit
+    memset(ini, 0, sizeof(ini));
+    if(h.iniZeit != 0) {
+        memcpy(ini, h.ini, sizeof(ini));
+        flags = leseU4(ini + 44) & (INI_POS | INI_LLA | INI_ALTINV | INI_DRIFT | INI_FREQ);
+        if(!uhrOk || jetzt - h.iniZeit > HILFSDATEN_EPH_ALTER * SEKUNDE) {
+            flags &= ~(unsigned long) (INI_DRIFT | INI_FREQ);
+            if(leseU4(ini + 12) < HILFSDATEN_POS_GENAUIGKEIT) {
+                schreibe(ini + 12, HILFSDATEN_POS_GENAUIGKEIT, 4);
+            }
+        }
+    }
+    schreibe(ini + 16, 0, 2);   // tmCfg
+    if(uhrOk) {
+        long long gps = jetzt / SEKUNDE - GPS_EPOCHE + GPS_SCHALTSEKUNDEN;
+
+        schreibe(ini + 18, (unsigned long) (gps / WOCHE), 2);
+        schreibe(ini + 20, (unsigned long) ((gps % WOCHE) * 1000 + (jetzt % SEKUNDE) / 1000), 4);
+        schreibe(ini + 24, (unsigned long) ((jetzt % 1000) * 1000), 4);
+        schreibe(ini + 28, HILFSDATEN_ZEITGENAUIGKEIT, 4);
+        schreibe(ini + 32, 0, 4);
+        flags |= INI_ZEIT;
+    } else {
+        memset(ini + 18, 0, 18);
+    }
+    schreibe(ini + 44, flags, 4);
+
+    if(flags != 0) {
+        if(senden(UBX_AID, UBX_AID_INI, ini, sizeof(ini)) == -1) {
+            return -1;
+        }
+        gesendet++;
+    }
+
+    if(!uhrOk) {
+        return gesendet;
+    }
+
+    for(int i = 0; i < HILFSDATEN_SATELLITEN; i++) {
+        if(h.ephZeit[i] != 0 && jetzt - h.ephZeit[i] <= HILFSDATEN_EPH_ALTER * SEKUNDE
+                && leseU4(h.eph[i]) == (unsigned long) i + 1) {
+            if(senden(UBX_AID, UBX_AID_EPH, h.eph[i], UBX_AID_EPH_LAENGE) == -1) {
+                return -1;
+            }
+            gesendet++;
+        }
+    }
+
+    for(int i = 0; i < HILFSDATEN_SATELLITEN; i++) {
+        if(h.almZeit[i] != 0 && jetzt - h.almZeit[i] <= HILFSDATEN_ALM_ALTER * SEKUNDE
+                && leseU4(h.alm[i]) == (unsigned long) i + 1) {
+            if(senden(UBX_AID, UBX_AID_ALM, h.alm[i], UBX_AID_ALM_LAENGE) == -1) {
+                return -1;
+            }
+            gesendet++;
+        }
+    }
+
+    return gesendet;
+}
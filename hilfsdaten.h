@@ -0,0 +1,62 @@
+/**
+ * @file hilfsdaten.h
+ *
+ * @brief Zwischenspeicher für die AID-Hilfsdaten des u-blox NEO-7M GPS-Moduls
+ *
+ * Ohne Hilfsdaten braucht das Modul nach einem Neustart mehrere zehn
+ * Sekunden bis zur ersten Lösung. Mit Ephemeriden, Almanach, ungefährer
+ * Position und Zeit sind es wenige Sekunden. Diese Daten werden im
+ * laufenden Betrieb mit AID-EPH, AID-ALM und AID-INI abgefragt, in einer
+ * Datei gespeichert und nach dem nächsten Start wieder hochgeladen.
+ *
+ * Ablauf:
+ *  - direkt nach #Init: #hilfsdaten_hochladen
+ *  - im Betrieb: #hilfsdaten_abfragen und #hilfsdaten_speichern, oder
+ *    mit dem GPS-Lesethread #gpsleser_hilfsdaten
+ *  - vor dem Beenden: #hilfsdaten_abfragen und #hilfsdaten_speichern
+ *
+ * @see https://www.u-blox.com/sites/default/files/products/documents/u-blox7-V14_ReceiverDescrProtSpec_%28GPS.G7-SW-12001%29_Public.pdf
+ */
+
+#ifndef HILFSDATEN_H_
+#define HILFSDATEN_H_
+
+#include "ubx.h"
+
+#define HILFSDATEN_SATELLITEN 32             /*!< GPS-Satelliten, SV 1 bis 32 */
+#define HILFSDATEN_EPH_ALTER (4 * 3600)      /*!< ältere Ephemeriden in s werden nicht hochgeladen */
+#define HILFSDATEN_ALM_ALTER (30 * 86400)    /*!< ältere Almanachdaten in s werden nicht hochgeladen */
+#define HILFSDATEN_ZEITGENAUIGKEIT 2000      /*!< angenommene Genauigkeit der Rechneruhr in ms */
+#define HILFSDATEN_POS_GENAUIGKEIT 10000000  /*!< Genauigkeit einer alten Position in cm (100 km) */
+#define HILFSDATEN_TIMEOUT 2000              /*!< Wartezeit auf die Antworten einer Abfrage in ms */
+#define GPS_SCHALTSEKUNDEN 18                /*!< GPS-Zeit minus UTC in s */
+
+/**
+ * @brief Zuletzt empfangene Hilfsdaten
+ *
+ * Die Nachrichten werden mit Nutzdaten so gespeichert, wie das Modul sie
+ * geschickt hat. Eine Zeit von 0 bedeutet, dass keine Daten vorliegen.
+ * Meldet das Modul für einen Satelliten keine Daten, bleiben ältere
+ * Daten erhalten, bis sie zu alt sind.
+ */
+typedef struct hilfsdaten {
+    char ini[UBX_AID_INI_LAENGE];
+    char alm[HILFSDATEN_SATELLITEN][UBX_AID_ALM_LAENGE];
+    char eph[HILFSDATEN_SATELLITEN][UBX_AID_EPH_LAENGE];
+    long long iniZeit;                        /*!< Empfangszeit in µs seit 1970 */
+    long long almZeit[HILFSDATEN_SATELLITEN];
+    long long ephZeit[HILFSDATEN_SATELLITEN];
+    unsigned int antworten;                   /*!< empfangene AID-Nachrichten, auch ohne Daten */
+} hilfsdaten;
+
+// Funktionsprototypen
+extern void hilfsdaten_init(hilfsdaten* h);
+extern void hilfsdaten_sammeln(unsigned char klasse, unsigned char id, const char* nutzdaten,
+                               unsigned int laenge, void* kontext);
+extern int hilfsdaten_anfordern(void);
+extern int hilfsdaten_abfragen(hilfsdaten* h, ubxParser* weiter);
+extern int hilfsdaten_speichern(const hilfsdaten* h, const char* datei);
+extern int hilfsdaten_laden(hilfsdaten* h, const char* datei);
+extern int hilfsdaten_hochladen(const char* datei);
+
+#endif // HILFSDATEN_H_
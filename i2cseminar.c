@@ -12,12 +12,24 @@
 #include "i2cusb/i2cusb.h"
 #include "LCD_I2C.h"
 #include "ublox.h"
+#include "ubx.h"
+#include "gpsleser.h"
+#include "aufzeichnung.h"
+#include "hilfsdaten.h"
+#include "gpszeit.h"
+
+/**
+ * @brief Gibt einen vom Parser erkannten NMEA-Satz aus
+ */
+void satzAusgeben(const char* satz, unsigned int laenge, void* kontext) {
+    (void) kontext;
+    printf("%.*s\n", (int) laenge, satz);
+}
 
 int main(void) {
 
-    char puffer[65535];
-    unsigned int readBytes;
-    int *t;
+    char puffer[256];
+    ubxParser parser;
 
 	Init(2, SCL90);
 	initDisp(0x27, 16, 2);
@@ -27,24 +39,58 @@ int main(void) {
     printstr("Hallo!", 6);
 	//print("Test???");
     /*
-    // u-blox Teil
-    //while(true) { //! @TODO sinnvolle Abbruchbedingung hinzufügen
-        // Anzahl der zu lesenden Bytes auslesen
-        randomReadUblox(253, puffer, 2);
-        //readBytes = ((unsigned int) puffer[0]) << 8; // High-Byte
-        //readBytes += (unsigned int) puffer[1];
-
-        printf("%X   %X   %u\n", puffer[0], puffer[1], readBytes);
-        getchar();
-        randomReadUblox(255, puffer, readBytes);
-
-        printf("Empfangene Nachricht: \n");
-        for(int i = 0; i < readBytes; i++) {
-            printf("%c", puffer[i]);
+    // u-blox Teil: Datenstrom lesen und vom Parser zerlegen lassen
+    ubx_parser_init(&parser, satzAusgeben, NULL, NULL);
+    while(true) { //! @TODO sinnvolle Abbruchbedingung hinzufügen
+        int anzahl = drainUblox(puffer, sizeof(puffer));
+        ubx_verarbeiten(&parser, puffer, anzahl);
+    }
+    stopPollUblox();
+    */
+    /*
+    // u-blox im eigenen Thread lesen, das Display läuft nebenher
+    gpsLeser leser;
+    gpsMeldung meldung;
+    hilfsdaten hilfe;
+    gpszeit zeit;
+    struct timespec utc;
+    double fehler;
+    hilfsdaten_hochladen("gps.hlf"); // schnellerer Start mit den Daten vom letzten Lauf
+    hilfsdaten_laden(&hilfe, "gps.hlf");
+    binaryModeUblox(true);
+    aufzeichnung_starten("gps.auf"); // optional, für gpsreplay
+    gpsleser_starten(&leser, GPSLESER_INTERVALL);
+    gpsleser_hilfsdaten(&leser, &hilfe, "gps.hlf", 600);
+    gpszeit_init(&zeit, 0, 0);
+    while(true) { //! @TODO sinnvolle Abbruchbedingung hinzufügen
+        while(gpsleser_holen(&leser, &meldung)) {
+            gpszeit_hinzufuegen(&zeit, &meldung);
+            bus_sperren();
+            setCursor(0, 1);
+            printstr(meldung.fix.fixOk ? "Fix " : "kein", 4);
+            bus_freigeben();
         }
-        printf("\n\n");
-   //}
-
+        if(gps_now(&zeit, &utc, &fehler)) { // Ereignisse mit GPS-Zeit versehen
+            printf("%ld.%09ld +- %.1f ms\n", (long) utc.tv_sec, utc.tv_nsec, fehler * 1e3);
+        }
+        delay(100);
+    }
+    gpsleser_stoppen(&leser);
+    aufzeichnung_beenden();
+    stopPollUblox();
+    */
+    /*
+    // zwei u-blox Module (das zweite auf 0x43 umgestellt) abwechselnd lesen
+    ublox erstes;
+    ublox zweites;
+    ublox* empfaenger[] = {&erstes, &zweites};
+    ublox_init(&erstes, UBLOX_ADR, satzAusgeben, NULL, NULL);
+    ublox_init(&zweites, 0x43, satzAusgeben, NULL, NULL);
+    while(true) { //! @TODO sinnvolle Abbruchbedingung hinzufügen
+        ublox_reihum(empfaenger, 2);
+        delay(50);
+    }
+    stopPollUblox();
     */
 	DeInit();
 
@@ -17,6 +17,8 @@
 #include <stdbool.h>
 #include <time.h>
 #include <math.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "i2cusb.h"
 
@@ -28,6 +30,65 @@
  **/
 bool initialized = false;
 
+/**
+ * Fähigkeiten des angeschlossenen Adapters, wird von #Init gefüllt.
+ * @see adapter_info
+ */
+adapterInfo adapter;
+
+/**
+ * Ein Eintrag im Sendefenster des Protokolls v2. Der Befehl wird bis
+ * zur Antwort aufbewahrt, damit er wiederholt werden kann.
+ */
+typedef struct {
+	bool belegt;       // gesendet, Antwort noch nicht abgeholt
+	bool fertig;       // Antwort empfangen
+	bool gepostet;     // niemand wartet, die Antwort wird nur geprüft
+	char* status;      // gepostetes 'H': hier wird der Busstatus gesammelt
+	unsigned char seq;
+	unsigned char gesendetVor; // Sequenznummer des nächsten Befehls beim letzten Senden
+	int versuche;
+	int blen;
+	char befehl[V2_NUTZDATEN_MAX];
+	int alen;
+	char antwort[V2_NUTZDATEN_MAX];
+} v2Eintrag;
+
+/**
+ * Zustand des Protokolls v2.
+ * @see protokoll_v2
+ */
+bool v2Aktiv = false;
+unsigned char v2Seq = 0;
+v2Eintrag v2Fenster[V2_FENSTER];
+
+/**
+ * Oder-Verknüpfung der Busstatus aller mit #hd44780_posten gesendeten
+ * Befehle, bis #hd44780_abschliessen sie abholt.
+ */
+char postStatus = 0;
+
+/**
+ * Der Adapter gibt gerade eine Wertefolge am IO-Port aus.
+ * @see port_welle_starten
+ */
+bool welleLaeuft = false;
+
+/**
+ * Abstand der Abtastungen und Anzahl der bisher abgeholten Werte, daraus
+ * ergeben sich die Zeitstempel.
+ * @see port_erfassung_abholen
+ */
+unsigned int erfassungIntervall = 0;
+unsigned long erfassungIndex = 0;
+
+/**
+ * Sperre für Bus und serielle Verbindung, wenn mehrere Threads den
+ * Adapter benutzen.
+ * @see bus_sperren
+ */
+pthread_mutex_t busSperre = PTHREAD_MUTEX_INITIALIZER;
+
 // interne Funktionen
 /**
  * @brief Interne Funktion zur Ausgabe des Busstatusses
@@ -48,6 +109,432 @@ void decodeStatus(unsigned char busStatus) {
 	printf("BB: %d\n\n", (status&BB ? 1 : 0));
 }
 
+/**
+ * @brief Interne Funktion, CRC-16/CCITT um ein Byte weiterrechnen
+ */
+unsigned short crc16(unsigned short crc, unsigned char byte) {
+	crc ^= (unsigned short) byte << 8;
+	for(int i = 0; i < 8; i++) {
+		crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+/**
+ * @brief Interne Funktion, sendet den Rahmen eines Fenstereintrags
+ */
+void v2_senden(v2Eintrag* e) {
+	char rahmen[V2_KOPF + V2_NUTZDATEN_MAX];
+	unsigned short crc = crc16(crc16(0xFFFF, e->seq), (unsigned char) e->blen);
+
+	rahmen[0] = (char) V2_START;
+	rahmen[1] = (char) e->seq;
+	rahmen[2] = (char) e->blen;
+	for(int i = 0; i < e->blen; i++) {
+		rahmen[3+i] = e->befehl[i];
+		crc = crc16(crc, (unsigned char) e->befehl[i]);
+	}
+	rahmen[3 + e->blen] = (char) (crc >> 8);
+	rahmen[4 + e->blen] = (char) (crc & 0xFF);
+
+	e->gesendetVor = v2Seq;
+
+#if DEBUG
+	printf("v2: Sende Rahmen %u: %c%c, Versuch %d\n", e->seq, e->befehl[0], e->befehl[1], e->versuche);
+#endif
+
+	sende_daten(fd, rahmen, V2_KOPF + e->blen);
+}
+
+/**
+ * @brief Interne Funktion, einen Befehl erneut senden
+ *
+ * Nach #V2_VERSUCHE Wiederholungen wird das Programm beendet.
+ */
+void v2_wiederholen(v2Eintrag* e) {
+	if(++e->versuche > V2_VERSUCHE) {
+		fprintf(stderr, "v2_wiederholen: Keine Antwort auf Befehl '%c%c' (Sequenznummer %u) nach %d Versuchen!\n",
+						e->befehl[0], e->befehl[1], e->seq, V2_VERSUCHE);
+		err_quit(fd);
+	}
+	v2_senden(e);
+}
+
+/**
+ * @brief Interne Funktion, prüft die Antwort auf einen geposteten Befehl
+ *
+ * @param status Ziel für den Busstatus eines 'H'-Befehls, NULL wenn er
+ *               nicht gebraucht wird
+ */
+void v2_pruefen(char* befehl, char* antwort, int alen, char* status) {
+	if(alen < 1 || antwort[0] != befehl[0]) {
+		fprintf(stderr, "v2_pruefen: Antwort auf Befehl '%c%c' fehlerhaft!\n", befehl[0], befehl[1]);
+		return;
+	}
+	// nur bei 'H' ist das letzte Byte ein Busstatus, 'N' gibt das Datenbyte zurück
+	if(befehl[0] == 'H' && status != NULL) {
+		*status |= antwort[alen-1];
+	}
+}
+
+/**
+ * @brief Interne Funktion, einen Rahmen des Protokolls v2 empfangen
+ *
+ * Die Antwort wird im passenden Fenstereintrag abgelegt. Da der
+ * Mikrocontroller die Befehle in der Reihenfolge der Sequenznummern
+ * ausführt, ist bei allen offenen Befehlen, die vor dem beantworteten
+ * gesendet wurden, die Antwort verloren gegangen. Nur diese und per NAK
+ * angeforderte Befehle werden wiederholt. Rahmen mit falscher CRC
+ * werden verworfen.
+ *
+ * @return false, wenn innerhalb des Timeouts kein Rahmen ankam
+ */
+bool v2_empfangen(void) {
+	char c;
+	unsigned char kopf[2];
+	unsigned char daten[V2_NUTZDATEN_MAX + 2];
+	unsigned short crc;
+	int n;
+
+	// Startbyte suchen
+	do {
+		if(lese_daten(fd, &c, 1) != 1) {
+			return false;
+		}
+	} while((unsigned char) c != V2_START);
+
+	if(lese_daten(fd, (char*) kopf, 2) != 2) {
+		return false;
+	}
+
+	n = (kopf[1] == V2_NAK) ? 0 : kopf[1];
+	if(n > V2_NUTZDATEN_MAX) {
+		return true; // kein Rahmen, weitersuchen
+	}
+	if(lese_daten(fd, (char*) daten, n + 2) != n + 2) {
+		return false;
+	}
+
+	crc = crc16(crc16(0xFFFF, kopf[0]), kopf[1]);
+	for(int i = 0; i < n; i++) {
+		crc = crc16(crc, daten[i]);
+	}
+	if(crc != ((daten[n] << 8) | daten[n+1])) {
+#if DEBUG
+		printf("v2: Rahmen mit falscher CRC verworfen\n");
+#endif
+		return true; // die fehlende Antwort fällt spätestens beim Timeout auf
+	}
+
+	v2Eintrag* e = &v2Fenster[kopf[0] % V2_FENSTER];
+	if(!e->belegt || e->fertig || e->seq != kopf[0]) {
+		return true; // doppelte Antwort
+	}
+
+	if(kopf[1] == V2_NAK) {
+		v2_wiederholen(e);
+		return true;
+	}
+
+	memcpy(e->antwort, daten, n);
+	e->alen = n;
+	e->fertig = true;
+
+	for(int i = 0; i < V2_FENSTER; i++) {
+		v2Eintrag* aelter = &v2Fenster[i];
+		unsigned char abstand = e->seq - aelter->gesendetVor;
+		if(aelter->belegt && !aelter->fertig && abstand < V2_FENSTER) {
+			v2_wiederholen(aelter);
+		}
+	}
+
+	if(e->gepostet) {
+		v2_pruefen(e->befehl, e->antwort, e->alen, e->status);
+		e->belegt = false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Interne Funktion, wartet auf die Antwort eines Befehls
+ *
+ * Kommt innerhalb des Timeouts gar nichts an, werden alle offenen
+ * Befehle wiederholt. Danach ist der Eintrag wieder frei, die Antwort
+ * bleibt bis zum nächsten #v2_posten auf diesem Platz lesbar. Gepostete
+ * Befehle gibt schon #v2_empfangen frei.
+ */
+void v2_warten(v2Eintrag* e) {
+	while(e->belegt && !e->fertig) {
+		if(!v2_empfangen()) {
+			for(int i = 0; i < V2_FENSTER; i++) {
+				if(v2Fenster[i].belegt && !v2Fenster[i].fertig) {
+					v2_wiederholen(&v2Fenster[i]);
+				}
+			}
+		}
+	}
+	e->belegt = false;
+}
+
+/**
+ * @brief Interne Funktion, einen Befehl in das Sendefenster stellen
+ *
+ * Ist das Fenster voll, wird zuerst auf die Antwort des ältesten
+ * Befehls gewartet.
+ *
+ * @param befehl Befehl des ursprünglichen Protokolls
+ * @param blen Länge des Befehls
+ * @param gepostet true: die Antwort wird nicht abgeholt
+ * @return Eintrag des Befehls im Fenster
+ */
+v2Eintrag* v2_posten(char* befehl, int blen, bool gepostet) {
+	v2Eintrag* e = &v2Fenster[v2Seq % V2_FENSTER];
+
+	if(e->belegt) {
+		v2_warten(e);
+	}
+
+	e->belegt = true;
+	e->fertig = false;
+	e->gepostet = gepostet;
+	e->status = NULL;
+	e->seq = v2Seq++;
+	e->versuche = 0;
+	e->blen = blen;
+	memcpy(e->befehl, befehl, blen);
+	e->alen = 0;
+
+	v2_senden(e);
+
+	return e;
+}
+
+/**
+ * @brief Interne Funktion, wartet auf die Antworten aller offenen Befehle
+ */
+void v2_synchronisieren(void) {
+	for(int i = 0; i < V2_FENSTER; i++) {
+		if(v2Fenster[i].belegt) {
+			v2_warten(&v2Fenster[i]);
+		}
+	}
+}
+
+/**
+ * @brief Interne Funktion, wartet auf die geposteten Befehle, die ihren
+ * Busstatus in status sammeln
+ */
+void v2_abwarten(const char* status) {
+	for(int i = 0; i < V2_FENSTER; i++) {
+		if(v2Fenster[i].belegt && v2Fenster[i].gepostet && v2Fenster[i].status == status) {
+			v2_warten(&v2Fenster[i]);
+		}
+	}
+}
+
+/**
+ * @brief Interne Funktion, sendet einen Befehl und liest die Antwort
+ *
+ * Je nach Einstellung wird das ursprüngliche Protokoll oder
+ * Protokoll v2 verwendet. Ist die Antwort kürzer als erwartet, wird
+ * der Rest des Puffers mit 0 gefüllt.
+ *
+ * @param befehl zu sendender Befehl
+ * @param blen Länge des Befehls
+ * @param antwort Puffer für die Antwort
+ * @param alen erwartete Länge der Antwort
+ */
+void uebertragung(char* befehl, int blen, char* antwort, int alen) {
+	if(!v2Aktiv) {
+		if(blen == 2) {
+			sende_befehl(fd, befehl);
+		} else {
+			sende_daten(fd, befehl, blen);
+		}
+		lese_antwort(fd, antwort, alen);
+		return;
+	}
+
+	v2Eintrag* e = v2_posten(befehl, blen, false);
+	v2_warten(e);
+
+	memset(antwort, 0, alen);
+	memcpy(antwort, e->antwort, (e->alen < alen) ? e->alen : alen);
+	if(e->alen != alen) {
+		fprintf(stderr, "uebertragung: Antwort auf '%c%c' hat falsche Länge! Erwartet: %d, bekommen: %d!\n",
+						befehl[0], befehl[1], alen, e->alen);
+	}
+}
+
+/**
+ * @brief Interne Funktion, sendet einen Befehl ohne auf die Antwort zu warten
+ *
+ * Bei Protokoll v2 wird die Antwort erst geprüft, wenn sie ankommt,
+ * sodass bis zu #V2_FENSTER Befehle gleichzeitig unterwegs sind. Beim
+ * ursprünglichen Protokoll wird sofort auf die Antwort gewartet.
+ *
+ * @param befehl zu sendender Befehl
+ * @param blen Länge des Befehls
+ * @param alen erwartete Länge der Antwort
+ * @param status Ziel für den Busstatus eines 'H'-Befehls oder NULL, muss
+ *               bis zur Antwort gültig bleiben (#v2_abwarten)
+ */
+void uebertragung_posten(char* befehl, int blen, int alen, char* status) {
+	char antwort[V2_NUTZDATEN_MAX];
+
+	if(!v2Aktiv) {
+		uebertragung(befehl, blen, antwort, alen);
+		v2_pruefen(befehl, antwort, alen, status);
+		return;
+	}
+
+	v2_posten(befehl, blen, true)->status = status;
+}
+
+/**
+ * @brief Interne Funktion, holt einen Puffer des Adapters ab ('F', 'I' oder 'f')
+ *
+ * Im ursprünglichen Protokoll kommen bis zu #UBLOX_ABHOLEN_MAX Bytes mit
+ * einem einzigen Befehl, im Protokoll v2 bis zu #UBLOX_RAHMEN_MAX. Es
+ * wird so lange abgeholt, bis der Puffer des Adapters leer oder der
+ * übergebene Puffer voll ist. Kündigt eine Antwort mehr Bytes an als
+ * angefragt, wird sie verworfen und das Abholen beendet.
+ *
+ * @param befehl Befehl, das letzte Byte wird mit der Anzahl überschrieben
+ * @param blen Länge des Befehls
+ * @param puffer Puffer für die Daten
+ * @param max Größe des Puffers
+ * @return Anzahl der abgeholten Bytes
+ */
+int abholen_befehl(char* befehl, int blen, char* puffer, unsigned int max) {
+
+	char kopf[2];
+	unsigned int gesamt = 0;
+	unsigned int anzahl;
+	unsigned int stueck = v2Aktiv ? UBLOX_RAHMEN_MAX : UBLOX_ABHOLEN_MAX;
+
+	while(gesamt < max) {
+		befehl[blen-1] = (char) ((max - gesamt < stueck) ? max - gesamt : stueck);
+
+		if(v2Aktiv) {
+			v2Eintrag* e = v2_posten(befehl, blen, false);
+			v2_warten(e);
+			if(e->alen < 2 || e->antwort[0] != befehl[0] || e->alen != 2 + (unsigned char) e->antwort[1]
+					|| (unsigned char) e->antwort[1] > (unsigned char) befehl[blen-1]) {
+				fprintf(stderr, "abholen: Antwort auf '%c' fehlerhaft!\n", befehl[0]);
+				break;
+			}
+			anzahl = (unsigned char) e->antwort[1];
+			memcpy(puffer + gesamt, e->antwort + 2, anzahl);
+		} else {
+			if(blen == 2) {
+				sende_befehl(fd, befehl);
+			} else {
+				sende_daten(fd, befehl, blen);
+			}
+			lese_antwort(fd, kopf, 2);
+			if(kopf[0] != befehl[0]) {
+				fprintf(stderr, "abholen: Lesen der Antwort fehlgeschlagen! Erwartet: '%cx', bekommen '%c%c'!\n",
+								befehl[0], kopf[0], kopf[1]);
+				err_quit(fd);
+			}
+			anzahl = (unsigned char) kopf[1];
+			if(anzahl > (unsigned char) befehl[blen-1]) {
+				// passt nicht zur Anfrage, Daten verwerfen und neu aufsetzen
+				char rest[255];
+				fprintf(stderr, "abholen: %u Bytes angekuendigt, aber nur %u angefragt!\n",
+								anzahl, (unsigned char) befehl[blen-1]);
+				lese_daten(fd, rest, anzahl);
+				leere_puffer(fd);
+				break;
+			}
+			if(anzahl > 0 && lese_daten(fd, puffer + gesamt, anzahl) != (int) anzahl) {
+				fprintf(stderr, "abholen: Nicht alle %u Bytes empfangen!\n", anzahl);
+				err_quit(fd);
+			}
+		}
+
+		gesamt += anzahl;
+
+		// weniger als angefragt: Puffer des Adapters ist leer
+		if(anzahl < (unsigned char) befehl[blen-1]) {
+			break;
+		}
+	}
+
+	return gesamt;
+}
+
+/**
+ * @brief Interne Funktion, #abholen_befehl für Befehle ohne Parameter
+ *
+ * @param befehlsbyte 'F' oder 'I'
+ * @param puffer Puffer für die Daten
+ * @param max Größe des Puffers
+ * @return Anzahl der abgeholten Bytes
+ */
+int abholen(char befehlsbyte, char* puffer, unsigned int max) {
+	char befehl[2];
+
+	befehl[0] = befehlsbyte;
+	return abholen_befehl(befehl, 2, puffer, max);
+}
+
+/**
+ * @brief Interne Funktion, fragt die Fähigkeiten des Adapters ab ('Q')
+ *
+ * Antwortet der Adapter nicht innerhalb von #FAEHIGKEITEN_TIMEOUT ms,
+ * handelt es sich um das ursprüngliche USB-ITS-Gerät.
+ */
+void faehigkeiten_abfragen(void) {
+
+	char befehl[2];
+	unsigned char info[2 + FAEHIGKEITEN_LAENGE];
+
+	memset(&adapter, 0, sizeof(adapter));
+	adapter.version = 1;
+	adapter.takte = 0x0F; // SCL90 bis SCL1_5
+
+	befehl[0] = 'Q';
+	befehl[1] = 0;
+
+	setze_timeout(fd, FAEHIGKEITEN_TIMEOUT);
+	sende_befehl(fd, befehl);
+	if(lese_daten(fd, (char*) info, 2) != 2 || info[0] != 'Q' || info[1] < FAEHIGKEITEN_LAENGE
+			|| lese_daten(fd, (char*) info + 2, FAEHIGKEITEN_LAENGE) != FAEHIGKEITEN_LAENGE) {
+		// unbekannter Befehl, eventuell angefangene Antwort verwerfen
+		setze_timeout(fd, cTimeoutInMs);
+		leere_puffer(fd);
+		return;
+	}
+	setze_timeout(fd, cTimeoutInMs);
+
+	// neuere Firmware darf mehr senden, als hier bekannt ist
+	if(info[1] > FAEHIGKEITEN_LAENGE) {
+		char rest[255];
+		lese_daten(fd, rest, info[1] - FAEHIGKEITEN_LAENGE);
+	}
+
+	adapter.i2cMicro = true;
+	adapter.version = info[2];
+	adapter.merkmale = (info[3] << 8) | info[4];
+	adapter.baudrate = ((unsigned long) info[5] << 16) | (info[6] << 8) | info[7];
+	adapter.takte = info[8];
+	adapter.rxPuffer = (info[9] << 8) | info[10];
+	adapter.txPuffer = (info[11] << 8) | info[12];
+	adapter.ubloxPuffer = (info[13] << 8) | info[14];
+	adapter.programmMax = info[15];
+	adapter.ergebnisPuffer = (info[16] << 8) | info[17];
+	adapter.hd44780Max = info[18];
+	adapter.v2Fenster = info[19];
+
+#if DEBUG
+	printf("Adapter: I2C-Micro, Protokoll %u, Merkmale 0x%04X, %lu Baud, Takte 0x%02X\n",
+			adapter.version, adapter.merkmale, adapter.baudrate, adapter.takte);
+#endif
+}
+
 // API-Funktionen
 /**
  * @brief Initialisierung des USB-ITS-Geräts
@@ -55,18 +542,30 @@ void decodeStatus(unsigned char busStatus) {
  * Diese Funktion initialisiert das USB-ITS-Gerät und muss zu Beginn
  * des Programms aufgerufen werden.
  *
+ * Danach werden die Fähigkeiten des Adapters abgefragt und, soweit
+ * vorhanden, Protokoll v2 eingeschaltet. Kennt der Adapter den
+ * gewünschten Takt nicht, wird SCL90 verwendet.
+ *
  * @param portNr Nummer des COM- bzw. ttyUSB-Ports
- * @param takt Bustakt für I2C-Bus (SCL90, SCL45, SCL11, SCL1_5)
+ * @param takt Bustakt für I2C-Bus (SCL90, SCL45, SCL11, SCL1_5, beim
+ *             I2C-Micro zusätzlich SCL100 und SCL400)
  *
  * @warning Anders als bei der Delphi-Implementierung ist der Bustakt zwingend anzugeben!
+ * @see i2c_takt
+ * @see adapter_info
  */
 void Init(int portNr, int takt) {
 
 	char puffer[3];
+	unsigned int sitzung = adapter.sitzung;
 
 	// Seriellen Port oeffnen
 	fd = oeffne_port(fd, portNr);
 
+	// Reste einer vorherigen Sitzung verwerfen (z.B. die Antwort auf das
+	// 'OP' aus DeInit), sonst passen die Antworten nicht zu den Befehlen
+	leere_puffer(fd);
+
 	// Reset des USB-ITS-Geraets
 	sende_befehl(fd, "XX");
 	lese_antwort(fd, puffer, 2);
@@ -75,6 +574,15 @@ void Init(int portNr, int takt) {
 		err_quit(fd);
 	}
 
+	welleLaeuft = false;
+	faehigkeiten_abfragen();
+	adapter.sitzung = sitzung + 1;
+
+	if(takt < 'A' || takt > 'H' || !(adapter.takte & (1 << (takt - 'A')))) {
+		fprintf(stderr, "Init: Takt '%c' wird vom Adapter nicht unterstuetzt, verwende SCL90!\n", (char) takt);
+		takt = SCL90;
+	}
+
 	// Setzen der Baudrate
 	puffer[0] = 'C';
 	puffer[1] = (char) takt;
@@ -86,6 +594,22 @@ void Init(int portNr, int takt) {
 	}
 
 	initialized = true;
+
+	// beim I2C-Micro den tatsaechlich eingestellten Takt abfragen, sonst
+	// gelten die Nennwerte des PCD8584
+	if(adapter_kann(FAEHIG_TAKT)) {
+		adapter.takt = i2c_takt(0);
+	} else if(takt <= SCL1_5) {
+		const unsigned long nennwert[] = { 90000, 45000, 11000, 1500 };
+		adapter.takt = nennwert[takt - SCL90];
+	}
+#if DEBUG
+	printf("Init: I2C-Takt %lu Hz\n", adapter.takt);
+#endif
+
+	if(adapter_kann(FAEHIG_V2)) {
+		protokoll_v2(true);
+	}
 }
 
 /**
@@ -99,6 +623,9 @@ void Init(int portNr, int takt) {
  * 			muss am Ende des Programms aufgerufen werden!
  */
 void DeInit(void) {
+	if(v2Aktiv) {
+		protokoll_v2(false);
+	}
 	sende_befehl(fd, "OP"); // Stopp-Condition erzeugen
 
 	// die Antwort ist nicht wirklich relevant...
@@ -152,8 +679,7 @@ char start_iic(bool MRX_ACK, char dest, char mode) {
 
 	befehl[1] = dest;
 
-	sende_befehl(fd, befehl);
-	lese_antwort(fd, puffer, 2);
+	uebertragung(befehl, 2, puffer, 2);
 	if(puffer[0] != befehl[0]) {
 		fprintf(stderr, "start_iic: Lesen der Antwort fehlgeschlagen! Erwartet: '%c%c', bekommen '%c%c'!\n",
 						dest, befehl[0], puffer[0], puffer[1]);
@@ -178,8 +704,7 @@ char start_iic(bool MRX_ACK, char dest, char mode) {
 char stop_iic(void) {
 	char puffer[2];
 
-	sende_befehl(fd, "OP");
-	lese_antwort(fd, puffer, 2);
+	uebertragung("OP", 2, puffer, 2);
 	if(puffer[0] != 'O' || puffer[1] != 'P') {
 		fprintf(stderr, "stop_iic: Lesen der Antwort fehlgeschlagen! Erwartet: '%x.%x', bekommen '%x.%x'!\n",
 						'O' & 0xFF, 'P' & 0xFF, puffer[0] & 0xFF, puffer[1] & 0xFF);
@@ -204,8 +729,7 @@ char wr_byte_iic(char b) {
 	befehl[0] = 'N';
 	befehl[1] = b;
 
-	sende_befehl(fd, befehl);
-	lese_antwort(fd, puffer, 2);
+	uebertragung(befehl, 2, puffer, 2);
 	if(puffer[0] != befehl[0] || puffer[1] != befehl[1]) {
 		fprintf(stderr, "wr_byte_iic: Lesen der Antwort fehlgeschlagen! Erwartet: '%x%x', bekommen '%x%x'!\n",
 						befehl[0] & 0xFF, befehl[1] & 0xFF, puffer[0] & 0xFF, puffer[1] & 0xFF);
@@ -215,6 +739,35 @@ char wr_byte_iic(char b) {
 	return puffer[1];
 }
 
+/**
+ * @brief Diese Funktion schreibt als Master mehrere Bytes auf den I2C-Bus.
+ *
+ * Bei Protokoll v2 werden alle Bytes bis auf das letzte ohne Warten auf
+ * die Antwort gesendet, sodass das Fenster ausgenutzt wird.
+ *
+ * @param b - die zu schreibenden Bytes
+ * @param laenge - Anzahl der Bytes
+ * @return Status des Busses nach der Übertragung des letzten Bytes
+ * @see Busstatus
+ * @see protokoll_v2
+ */
+char wr_bytes_iic(char* b, unsigned int laenge) {
+
+	char befehl[2];
+
+	if(laenge == 0) {
+		return 0;
+	}
+
+	befehl[0] = 'N';
+	for(unsigned int i = 0; i < laenge-1; i++) {
+		befehl[1] = b[i];
+		uebertragung_posten(befehl, 2, 2, NULL);
+	}
+
+	return wr_byte_iic(b[laenge-1]);
+}
+
 /**
  * @brief Diese Funktion liest ein Byte als Master-Receiver vom I2C-Bus
  * @param b Puffer für das empfangene Byte
@@ -235,8 +788,7 @@ char rd_byte_iic(char* b, bool NOACK) {
 	else
 		befehl[1] = '1';
 
-	sende_befehl(fd, befehl);
-	lese_antwort(fd, puffer, 3);
+	uebertragung(befehl, 2, puffer, 3);
 	if(puffer[0] != befehl[0]) {
 		fprintf(stderr, "rd_byte_iic: Lesen der Antwort fehlgeschlagen! Erwartet: '%cxx', bekommen '%c%c%c'!\n",
 						befehl[0], puffer[0], puffer[1], puffer[2]);
@@ -279,8 +831,7 @@ char restart_iic(bool MRX_ACK, char dest, char mode) {
 
 	befehl[1] = dest;
 
-	sende_befehl(fd, befehl);
-	lese_antwort(fd, puffer, 2);
+	uebertragung(befehl, 2, puffer, 2);
 	if(puffer[0] != befehl[0]) {
 		fprintf(stderr, "restart_iic: Lesen der Antwort fehlgeschlagen! Erwartet: '%cx', bekommen '%c%c'!\n",
 						befehl[0], puffer[0], puffer[1]);
@@ -305,8 +856,7 @@ void wr_byte_port(char zuSchreiben) {
 	befehl[0] = 'W';
 	befehl[1] = zuSchreiben;
 
-	sende_befehl(fd, befehl);
-	lese_antwort(fd, puffer, 2);
+	uebertragung(befehl, 2, puffer, 2);
 	if(puffer[0] != befehl[0] || puffer[1] != befehl[1]) {
 		fprintf(stderr, "wr_byte_port: Lesen der Antwort fehlgeschlagen! Erwartet: '%c%c', bekommen '%c%c'!\n",
 						befehl[0], befehl[1], puffer[0], puffer[1]);
@@ -326,8 +876,7 @@ void rd_byte_port(char* gelesen) {
 	befehl[0] = 'D';
 	befehl[1] = 'D';
 
-	sende_befehl(fd, befehl);
-	lese_antwort(fd, puffer, 2);
+	uebertragung(befehl, 2, puffer, 2);
 	if(puffer[0] != befehl[0]) {
 		fprintf(stderr, "rd_byte_port: Lesen der Antwort fehlgeschlagen! Erwartet: '%cx', bekommen '%c%c'!\n",
 						befehl[0], puffer[0], puffer[1]);
@@ -346,6 +895,24 @@ bool is_initialized(void) {
 	return initialized;
 }
 
+/**
+ * @brief Beschreibung des angeschlossenen Adapters
+ * @return Fähigkeiten, Puffergrößen und eingestellter Takt
+ * @see Faehigkeiten
+ */
+const adapterInfo* adapter_info(void) {
+	return &adapter;
+}
+
+/**
+ * @brief Prüfen, ob der Adapter eine Erweiterung unterstützt
+ * @param merkmal FAEHIG_...
+ * @return true, falls alle angegebenen Merkmale vorhanden sind
+ */
+bool adapter_kann(unsigned short merkmal) {
+	return (adapter.merkmale & merkmal) == merkmal;
+}
+
 /**
  * @brief Einschalten des Relais für die zusätzliche Busversorgung
  */
@@ -357,8 +924,7 @@ void relais_on(void) {
 	befehl[0] = 'P';
 	befehl[1] = '1';
 
-	sende_befehl(fd, befehl);
-	lese_antwort(fd, puffer, 2);
+	uebertragung(befehl, 2, puffer, 2);
 	if(puffer[0] != befehl[0] || puffer[1] != befehl[1]) {
 		fprintf(stderr, "relais_on: Lesen der Antwort fehlgeschlagen! Erwartet: '%c%c', bekommen '%c%c'!\n",
 						befehl[0], befehl[1], puffer[0], puffer[1]);
@@ -377,8 +943,7 @@ void relais_off(void) {
 	befehl[0] = 'P';
 	befehl[1] = '0';
 
-	sende_befehl(fd, befehl);
-	lese_antwort(fd, puffer, 2);
+	uebertragung(befehl, 2, puffer, 2);
 	if(puffer[0] != befehl[0] || puffer[1] != befehl[1]) {
 		fprintf(stderr, "relais_off: Lesen der Antwort fehlgeschlagen! Erwartet: '%c%c', bekommen '%c%c'!\n",
 						befehl[0], befehl[1], puffer[0], puffer[1]);
@@ -397,8 +962,7 @@ void led_on(void) {
 	befehl[0] = 'L';
 	befehl[1] = '1';
 
-	sende_befehl(fd, befehl);
-	lese_antwort(fd, puffer, 2);
+	uebertragung(befehl, 2, puffer, 2);
 	if(puffer[0] != befehl[0] || puffer[1] != befehl[1]) {
 		fprintf(stderr, "led_on: Lesen der Antwort fehlgeschlagen! Erwartet: '%c%c', bekommen '%c%c'!\n",
 						befehl[0], befehl[1], puffer[0], puffer[1]);
@@ -417,8 +981,7 @@ void led_off(void) {
 	befehl[0] = 'L';
 	befehl[1] = '0';
 
-	sende_befehl(fd, befehl);
-	lese_antwort(fd, puffer, 2);
+	uebertragung(befehl, 2, puffer, 2);
 	if(puffer[0] != befehl[0] || puffer[1] != befehl[1]) {
 		fprintf(stderr, "led_off: Lesen der Antwort fehlgeschlagen! Erwartet: '%c%c', bekommen '%c%c'!\n",
 						befehl[0], befehl[1], puffer[0], puffer[1]);
@@ -426,6 +989,757 @@ void led_off(void) {
 	}
 }
 
+/**
+ * @brief Protokoll v2 ein- oder ausschalten
+ *
+ * Beim Einschalten wird der Adapter zurückgesetzt ('XX'), damit die
+ * Sequenznummern auf beiden Seiten bei 0 beginnen, und anschließend
+ * mit einem gerahmten 'EE' geprüft, ob er das Protokoll versteht.
+ * Das originale USB-ITS-Gerät kennt Protokoll v2 nicht, dann bleibt
+ * das ursprüngliche Protokoll aktiv. Auch beim Ausschalten wird ein
+ * Reset gesendet, danach nimmt der Adapter wieder ungerahmte Befehle an.
+ * #Init schaltet Protokoll v2 ein, wenn der Adapter es unterstützt.
+ *
+ * @param aktiv true: Protokoll v2 verwenden
+ * @return true, wenn das gewünschte Protokoll aktiv ist
+ * @see ProtokollV2
+ */
+bool protokoll_v2(bool aktiv) {
+
+	char puffer[2];
+
+	if(v2Aktiv) {
+		v2_synchronisieren();
+		v2Aktiv = false;
+		setze_timeout(fd, cTimeoutInMs);
+	}
+
+	// Reset, auch zum Verlassen von Protokoll v2
+	sende_befehl(fd, "XX");
+	lese_antwort(fd, puffer, 2);
+	if(puffer[0] != 'X' || puffer[1] != 'X') {
+		fprintf(stderr, "protokoll_v2: Lesen der Antwort fehlgeschlagen! Erwartet: 'XX', bekommen '%c%c'!\n", puffer[0], puffer[1]);
+		err_quit(fd);
+	}
+
+	// der Reset stoppt auch die Ausgabe am IO-Port
+	welleLaeuft = false;
+
+	if(!aktiv) {
+		return true;
+	}
+
+	if(!adapter_kann(FAEHIG_V2)) {
+		return false;
+	}
+
+	for(int i = 0; i < V2_FENSTER; i++) {
+		v2Fenster[i].belegt = false;
+	}
+	v2Seq = 0;
+
+	// Probe ohne Wiederholungen, ein unbekanntes Gerät antwortet nicht
+	v2Eintrag* e = v2_posten("EE", 2, false);
+	v2_empfangen();
+	e->belegt = false;
+	if(!e->fertig || e->alen != 2 || e->antwort[0] != 'E') {
+		leere_puffer(fd);
+		return false;
+	}
+
+	// Rahmen sind kurz, verlorene Antworten sollen schnell wiederholt werden
+	setze_timeout(fd, V2_TIMEOUT);
+	v2Aktiv = true;
+	return true;
+}
+
+/**
+ * @brief Überprüfen, ob der Adapter den HD44780-Befehl ('H') kennt
+ *
+ * Das originale USB-ITS-Gerät kennt den Befehl nicht, ausschlaggebend
+ * ist die Abfrage der Fähigkeiten in #Init.
+ *
+ * @return true: #hd44780_schreiben kann verwendet werden
+ */
+bool hd44780_unterstuetzt(void) {
+	return adapter_kann(FAEHIG_HD44780);
+}
+
+/**
+ * @brief Zeichen oder Befehle über einen PCF8574 an ein HD44780-LCD senden
+ *
+ * Das Aufteilen in Nibbles, der Enable-Puls und die Wartezeiten des
+ * Displays werden vom Mikrocontroller übernommen, sodass pro Aufruf nur
+ * ein Befehl und eine Antwort über die serielle Schnittstelle gehen statt
+ * sechs I2C-Transaktionen pro Zeichen.
+ *
+ * @param adr I2C-Adresse des PCF8574
+ * @param modus unteres Nibble des Expanderbytes (Rs und Hintergrundbeleuchtung)
+ * @param daten zu sendende Zeichen bzw. Befehlsbytes
+ * @param laenge Anzahl der Bytes, längere Folgen als #HD44780_MAX werden aufgeteilt
+ * @return Status des Busses nach der Übertragung, 0 ohne Daten
+ * @see Busstatus
+ * @see hd44780_unterstuetzt
+ */
+char hd44780_schreiben(char adr, char modus, char* daten, unsigned int laenge) {
+
+	char befehl[4 + HD44780_MAX];
+	char puffer[2];
+	char status = 0; // nicht postStatus, dort sammelt hd44780_posten
+
+	// nichts zu senden, der Bus bleibt unberührt
+	if(laenge == 0) {
+		return 0;
+	}
+
+	while(laenge > 0) {
+		unsigned int n = (laenge > HD44780_MAX) ? HD44780_MAX : laenge;
+
+		befehl[0] = 'H';
+		befehl[1] = (char) n;
+		befehl[2] = adr;
+		befehl[3] = modus;
+		for(unsigned int i = 0; i < n; i++) {
+			befehl[4+i] = daten[i];
+		}
+
+		daten += n;
+		laenge -= n;
+
+		// nur auf den letzten Teil warten, die anderen laufen im Fenster mit
+		if(laenge > 0) {
+			uebertragung_posten(befehl, 4 + n, 2, &status);
+		}
+	}
+
+	uebertragung(befehl, 4 + befehl[1], puffer, 2);
+	if(puffer[0] != befehl[0]) {
+		fprintf(stderr, "hd44780_schreiben: Lesen der Antwort fehlgeschlagen! Erwartet: '%cx', bekommen '%c%c'!\n",
+						befehl[0], puffer[0], puffer[1]);
+		err_quit(fd);
+	}
+
+	// eine verlorene Antwort auf einen früheren Teil kann noch ausstehen
+	if(v2Aktiv) {
+		v2_abwarten(&status);
+	}
+	status |= puffer[1];
+
+#if DEBUG
+	decodeStatus(status);
+#endif
+
+	return status;
+}
+
+/**
+ * @brief Wie #hd44780_schreiben, wartet aber nicht auf die Antwort
+ *
+ * Mit Protokoll v2 laufen so die Aktualisierungen mehrerer Displays
+ * gemeinsam durch das Fenster. Der Status wird in #postStatus
+ * gesammelt und von #hd44780_abschliessen zurückgegeben.
+ *
+ * @param adr I2C-Adresse des PCF8574
+ * @param modus unteres Nibble des Expanderbytes (Rs und Hintergrundbeleuchtung)
+ * @param daten zu sendende Zeichen bzw. Befehlsbytes
+ * @param laenge Anzahl der Bytes
+ * @see hd44780_abschliessen
+ */
+void hd44780_posten(char adr, char modus, char* daten, unsigned int laenge) {
+
+	char befehl[4 + HD44780_MAX];
+
+	while(laenge > 0) {
+		unsigned int n = (laenge > HD44780_MAX) ? HD44780_MAX : laenge;
+
+		befehl[0] = 'H';
+		befehl[1] = (char) n;
+		befehl[2] = adr;
+		befehl[3] = modus;
+		for(unsigned int i = 0; i < n; i++) {
+			befehl[4+i] = daten[i];
+		}
+		uebertragung_posten(befehl, 4 + n, 2, &postStatus);
+
+		daten += n;
+		laenge -= n;
+	}
+}
+
+/**
+ * @brief Auf alle mit #hd44780_posten gesendeten Befehle warten
+ * @return Oder-Verknüpfung der Busstatus aller Befehle seit dem letzten Aufruf
+ * @see Busstatus
+ */
+char hd44780_abschliessen(void) {
+
+	char status;
+
+	if(v2Aktiv) {
+		v2_synchronisieren();
+	}
+	status = postStatus;
+	postStatus = 0;
+
+#if DEBUG
+	decodeStatus(status);
+#endif
+
+	return status;
+}
+
+/**
+ * @brief u-blox-Modul vom Adapter im Hintergrund abfragen lassen
+ *
+ * Der Mikrocontroller liest dann selbstständig die Bytezahl aus den
+ * Registern 0xFD/0xFE und sammelt den Datenstrom aus 0xFF in einem
+ * eigenen Puffer, der mit #ublox_abholen geleert wird. So läuft der
+ * Puffer des Moduls auch dann nicht über, wenn der Host beschäftigt ist.
+ *
+ * @param adr I2C-Adresse des Moduls, 0 schaltet die Abfrage ab
+ * @return true bei Erfolg
+ * @warning Nur mit dem I2C-Micro möglich!
+ */
+bool ublox_hintergrund(char adr) {
+
+	char befehl[2];
+	char puffer[2];
+
+	if(!adapter_kann(FAEHIG_UBLOX)) {
+		return false;
+	}
+
+	befehl[0] = 'G';
+	befehl[1] = adr;
+
+	uebertragung(befehl, 2, puffer, 2);
+	if(puffer[0] != befehl[0] || puffer[1] != befehl[1]) {
+		fprintf(stderr, "ublox_hintergrund: Lesen der Antwort fehlgeschlagen! Erwartet: '%c%x', bekommen '%c%x'!\n",
+						befehl[0], befehl[1] & 0xFF, puffer[0], puffer[1] & 0xFF);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Im Adapter gesammelte Daten des u-blox-Moduls abholen
+ *
+ * Im ursprünglichen Protokoll kommen bis zu #UBLOX_ABHOLEN_MAX Bytes mit
+ * einem einzigen Befehl, im Protokoll v2 bis zu #UBLOX_RAHMEN_MAX.
+ * Es wird so lange abgeholt, bis der Puffer des Adapters leer oder
+ * der übergebene Puffer voll ist.
+ *
+ * @param puffer Puffer für die Daten
+ * @param max Größe des Puffers
+ * @return Anzahl der abgeholten Bytes
+ * @see ublox_hintergrund
+ */
+int ublox_abholen(char* puffer, unsigned int max) {
+	if(!adapter_kann(FAEHIG_UBLOX)) {
+		return 0;
+	}
+	return abholen('F', puffer, max);
+}
+
+/**
+ * @brief Weiteres u-blox-Modul im Hintergrund abfragen lassen
+ *
+ * Wie #ublox_hintergrund, aber für einen der Plätze 1 bis
+ * #UBLOX_MODULE-1. Der Adapter fragt alle eingetragenen Module reihum ab
+ * und sammelt ihre Daten in getrennten Puffern. Platz 0 ist das Modul
+ * von #ublox_hintergrund.
+ *
+ * @param platz Platz im Adapter
+ * @param adr I2C-Adresse des Moduls, 0 schaltet die Abfrage ab
+ * @return true bei Erfolg
+ * @warning Nur mit dem I2C-Micro möglich!
+ */
+bool ublox_hintergrund_platz(unsigned char platz, char adr) {
+
+	char befehl[3];
+	char puffer[3];
+
+	if(platz == 0) {
+		return ublox_hintergrund(adr);
+	}
+	if(!adapter_kann(FAEHIG_UBLOX_MEHR) || platz >= UBLOX_MODULE) {
+		return false;
+	}
+
+	befehl[0] = 'g';
+	befehl[1] = (char) platz;
+	befehl[2] = adr;
+
+	uebertragung(befehl, 3, puffer, 3);
+	if(puffer[0] != befehl[0] || puffer[1] != befehl[1] || puffer[2] != befehl[2]) {
+		fprintf(stderr, "ublox_hintergrund_platz: Lesen der Antwort fehlgeschlagen! Erwartet: '%c%x%x', bekommen '%c%x%x'!\n",
+						befehl[0], befehl[1] & 0xFF, befehl[2] & 0xFF, puffer[0], puffer[1] & 0xFF, puffer[2] & 0xFF);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Gesammelte Daten eines weiteren u-blox-Moduls abholen
+ *
+ * @param platz Platz im Adapter, siehe #ublox_hintergrund_platz
+ * @param puffer Puffer für die Daten
+ * @param max Größe des Puffers
+ * @return Anzahl der abgeholten Bytes
+ */
+int ublox_abholen_platz(unsigned char platz, char* puffer, unsigned int max) {
+
+	char befehl[3];
+
+	if(platz == 0) {
+		return ublox_abholen(puffer, max);
+	}
+	if(!adapter_kann(FAEHIG_UBLOX_MEHR) || platz >= UBLOX_MODULE) {
+		return 0;
+	}
+
+	befehl[0] = 'f';
+	befehl[1] = (char) platz;
+	return abholen_befehl(befehl, 3, puffer, max);
+}
+
+/**
+ * @brief Programm in den Adapter laden
+ *
+ * Ein vorher geladenes Programm wird ersetzt und eine laufende
+ * periodische Ausführung gestoppt.
+ *
+ * @param programm Operationen des Programms, siehe @ref Programm
+ * @param laenge Länge des Programms (max. #PROGRAMM_MAX)
+ * @return true bei Erfolg, false auch wenn der Adapter einen
+ *         Schreibzugriff über 32 Bytes abgelehnt hat
+ * @warning Nur mit dem I2C-Micro möglich!
+ */
+bool programm_laden(char* programm, unsigned int laenge) {
+
+	char befehl[2 + PROGRAMM_STUECK];
+	char puffer[2];
+	unsigned int gesendet = 0;
+	unsigned int n;
+
+	if(!adapter_kann(FAEHIG_PROGRAMM)) {
+		fprintf(stderr, "programm_laden: Adapter unterstuetzt keine Programme!\n");
+		return false;
+	}
+
+	if(laenge > PROGRAMM_MAX) {
+		fprintf(stderr, "programm_laden: Programm zu lang (%u Bytes, max. %d)!\n", laenge, PROGRAMM_MAX);
+		return false;
+	}
+
+	befehl[0] = 'M';
+	befehl[1] = 0;
+
+	// erst löschen, dann stückweise anhängen
+	do {
+		uebertragung(befehl, 2 + (unsigned char) befehl[1], puffer, 2);
+		gesendet += (unsigned char) befehl[1];
+		if(puffer[0] != befehl[0] || (unsigned char) puffer[1] != gesendet) {
+			fprintf(stderr, "programm_laden: Lesen der Antwort fehlgeschlagen! Erwartet: '%c%x', bekommen '%c%x'!\n",
+							befehl[0], gesendet, puffer[0], puffer[1] & 0xFF);
+			return false;
+		}
+
+		n = (laenge - gesendet < PROGRAMM_STUECK) ? laenge - gesendet : PROGRAMM_STUECK;
+		befehl[1] = (char) n;
+		memcpy(befehl + 2, programm + gesendet, n);
+	} while(n > 0);
+
+	return true;
+}
+
+/**
+ * @brief Geladenes Programm einmal ausführen
+ *
+ * Die gelesenen Bytes werden mit #programm_ergebnisse abgeholt.
+ *
+ * @return Busstatus: 0, #AD0LRB falls ein Zugriff nicht bestätigt
+ *         wurde oder #BER bei einem fehlerhaften Programm
+ * @warning Nur mit dem I2C-Micro möglich!
+ */
+char programm_ausfuehren(void) {
+
+	char befehl[2];
+	char puffer[2];
+
+	if(!adapter_kann(FAEHIG_PROGRAMM)) {
+		return BER;
+	}
+
+	befehl[0] = 'J';
+	befehl[1] = (char) PROGRAMM_EINMAL;
+
+	uebertragung(befehl, 2, puffer, 2);
+	if(puffer[0] != befehl[0]) {
+		fprintf(stderr, "programm_ausfuehren: Lesen der Antwort fehlgeschlagen! Erwartet: '%c', bekommen '%c'!\n",
+						befehl[0], puffer[0]);
+		err_quit(fd);
+	}
+
+#if DEBUG
+	decodeStatus(puffer[1]);
+#endif
+
+	return puffer[1];
+}
+
+/**
+ * @brief Geladenes Programm periodisch im Adapter ausführen
+ *
+ * Während der Host selbst eine Übertragung begonnen hat (#start_iic bis
+ * #stop_iic), wird die Ausführung aufgeschoben.
+ *
+ * @param ms Periode in ms, wird auf Vielfache von #PROGRAMM_TAKT
+ *           abgerundet, 0 stoppt die Ausführung
+ * @return true bei Erfolg
+ * @warning Nur mit dem I2C-Micro möglich!
+ */
+bool programm_periodisch(unsigned int ms) {
+
+	char befehl[2];
+	char puffer[2];
+	unsigned int periode = ms / PROGRAMM_TAKT;
+
+	if(!adapter_kann(FAEHIG_PROGRAMM)) {
+		return false;
+	}
+
+	if(ms > 0 && periode == 0) {
+		periode = 1;
+	}
+	if(periode >= PROGRAMM_EINMAL) {
+		periode = PROGRAMM_EINMAL - 1;
+	}
+
+	befehl[0] = 'J';
+	befehl[1] = (char) periode;
+
+	uebertragung(befehl, 2, puffer, 2);
+	if(puffer[0] != befehl[0] || puffer[1] != befehl[1]) {
+		fprintf(stderr, "programm_periodisch: Lesen der Antwort fehlgeschlagen! Erwartet: '%c%x', bekommen '%c%x'!\n",
+						befehl[0], befehl[1] & 0xFF, puffer[0], puffer[1] & 0xFF);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Ergebnisse des Programms abholen
+ *
+ * Läuft der Ergebnispuffer im Adapter über, werden neue Bytes verworfen.
+ *
+ * @param puffer Puffer für die Daten
+ * @param max Größe des Puffers
+ * @return Anzahl der abgeholten Bytes
+ * @see programm_ausfuehren
+ * @see programm_periodisch
+ */
+int programm_ergebnisse(char* puffer, unsigned int max) {
+	if(!adapter_kann(FAEHIG_PROGRAMM)) {
+		return 0;
+	}
+	return abholen('I', puffer, max);
+}
+
+/**
+ * @brief Werte für die Ausgabe am IO-Port in den Adapter laden
+ *
+ * Die Werte werden an den Puffer des Adapters angehängt. Ist er voll,
+ * wird gewartet, bis die laufende Ausgabe wieder Platz geschaffen hat.
+ * Vor dem Start der Ausgabe passen höchstens 255 Werte in den Puffer.
+ *
+ * @param werte auszugebende Werte, Bit 0 auf IO_0
+ * @param anzahl Anzahl der Werte
+ * @return true bei Erfolg
+ * @warning Nur mit dem I2C-Micro möglich!
+ * @see Welle
+ */
+bool port_welle_laden(char* werte, unsigned int anzahl) {
+
+	char befehl[2 + WELLE_MAX];
+	char puffer[2];
+	unsigned int gesendet = 0;
+	unsigned int frei;
+	unsigned int n = 0;
+
+	if(!adapter_kann(FAEHIG_WELLE)) {
+		fprintf(stderr, "port_welle_laden: Adapter unterstuetzt keine Wertefolgen!\n");
+		return false;
+	}
+
+	befehl[0] = 'w';
+
+	do {
+		befehl[1] = (char) n;
+		memcpy(befehl + 2, werte + gesendet, n);
+
+		uebertragung(befehl, 2 + n, puffer, 2);
+		if(puffer[0] != befehl[0]) {
+			fprintf(stderr, "port_welle_laden: Lesen der Antwort fehlgeschlagen! Erwartet: '%cx', bekommen '%c%c'!\n",
+							befehl[0], puffer[0], puffer[1]);
+			return false;
+		}
+		gesendet += n;
+		frei = (unsigned char) puffer[1];
+
+		// ohne laufende Ausgabe wird der Puffer nie wieder frei
+		if(frei == 0 && !welleLaeuft && gesendet < anzahl) {
+			fprintf(stderr, "port_welle_laden: Puffer des Adapters voll!\n");
+			return false;
+		}
+
+		n = anzahl - gesendet;
+		if(n > frei) {
+			n = frei;
+		}
+		if(n > WELLE_MAX) {
+			n = WELLE_MAX;
+		}
+	} while(gesendet < anzahl);
+
+	return true;
+}
+
+/**
+ * @brief Ausgabe der geladenen Werte am IO-Port starten
+ *
+ * @param intervall Abstand der Werte in µs (#WELLE_INTERVALL_MIN bis 65535)
+ * @param wiederholen true: Puffer endlos wiederholen, false: jeden Wert
+ *                    einmal ausgeben (Streaming)
+ * @return true bei Erfolg
+ * @warning Nur mit dem I2C-Micro möglich!
+ * @see Welle
+ */
+bool port_welle_starten(unsigned int intervall, bool wiederholen) {
+
+	char befehl[4];
+	char puffer[4];
+
+	if(!adapter_kann(FAEHIG_WELLE)) {
+		return false;
+	}
+
+	if(intervall > 0xFFFF) {
+		intervall = 0xFFFF;
+	}
+
+	befehl[0] = 'Y';
+	befehl[1] = wiederholen ? WELLE_WIEDERHOLEN : WELLE_STREAMING;
+	befehl[2] = (char) ((intervall >> 8) & 0xFF);
+	befehl[3] = (char) (intervall & 0xFF);
+
+	uebertragung(befehl, 4, puffer, 4);
+	if(memcmp(befehl, puffer, 4) != 0) {
+		fprintf(stderr, "port_welle_starten: Lesen der Antwort fehlgeschlagen! Erwartet: '%c', bekommen '%c'!\n",
+						befehl[0], puffer[0]);
+		return false;
+	}
+
+	welleLaeuft = intervall > 0;
+	return true;
+}
+
+/**
+ * @brief Ausgabe am IO-Port stoppen und den Puffer des Adapters leeren
+ *
+ * Der zuletzt ausgegebene Wert bleibt am Port stehen.
+ *
+ * @return true bei Erfolg
+ */
+bool port_welle_stoppen(void) {
+	return port_welle_starten(0, false);
+}
+
+/**
+ * @brief Erfassung am IO-Port starten
+ *
+ * Die Pins des IO-Ports werden dabei als Eingänge geschaltet, eine
+ * laufende Ausgabe von Wertefolgen wird abgebrochen. Noch nicht
+ * abgeholte Werte einer vorherigen Erfassung gehen verloren.
+ *
+ * @param intervall Abstand der Abtastungen in µs (#WELLE_INTERVALL_MIN bis 65535), 0 stoppt
+ * @param maske Triggermaske, 0 startet sofort
+ * @param wert Triggerwert, die Erfassung beginnt, sobald (Port & maske) == wert
+ * @param anzahl Anzahl der Abtastungen (max. 65535), 0 stoppt
+ * @return true bei Erfolg
+ * @warning Nur mit dem I2C-Micro möglich!
+ * @see Erfassung
+ */
+bool port_erfassung_starten(unsigned int intervall, char maske, char wert, unsigned int anzahl) {
+
+	char befehl[7];
+	char puffer[7];
+
+	if(!adapter_kann(FAEHIG_ERFASSUNG)) {
+		fprintf(stderr, "port_erfassung_starten: Adapter unterstuetzt keine Erfassung!\n");
+		return false;
+	}
+
+	if(intervall > 0xFFFF) {
+		intervall = 0xFFFF;
+	}
+	if(intervall > 0 && intervall < WELLE_INTERVALL_MIN) {
+		intervall = WELLE_INTERVALL_MIN;
+	}
+	if(anzahl > 0xFFFF) {
+		anzahl = 0xFFFF;
+	}
+
+	befehl[0] = 'd';
+	befehl[1] = (char) ((intervall >> 8) & 0xFF);
+	befehl[2] = (char) (intervall & 0xFF);
+	befehl[3] = maske;
+	befehl[4] = wert;
+	befehl[5] = (char) ((anzahl >> 8) & 0xFF);
+	befehl[6] = (char) (anzahl & 0xFF);
+
+	uebertragung(befehl, 7, puffer, 7);
+	if(memcmp(befehl, puffer, 7) != 0) {
+		fprintf(stderr, "port_erfassung_starten: Lesen der Antwort fehlgeschlagen! Erwartet: '%c', bekommen '%c'!\n",
+						befehl[0], puffer[0]);
+		return false;
+	}
+
+	welleLaeuft = false;
+	erfassungIntervall = intervall;
+	erfassungIndex = 0;
+	return true;
+}
+
+/**
+ * @brief Erfasste Werte abholen
+ *
+ * Es wird nur abgeholt, was im Adapter bereits vorliegt, bei laufender
+ * Erfassung also eventuell weniger als max. Ob noch Werte folgen,
+ * liefert #port_erfassung_zustand.
+ *
+ * @param werte Puffer für die Werte, Bit 0 von IO_0
+ * @param zeiten Puffer für die Zeitstempel in µs ab dem Trigger, oder NULL
+ * @param max Größe der Puffer
+ * @return Anzahl der abgeholten Werte
+ * @see Erfassung
+ */
+int port_erfassung_abholen(char* werte, unsigned long* zeiten, unsigned int max) {
+
+	int anzahl;
+
+	if(!adapter_kann(FAEHIG_ERFASSUNG)) {
+		return 0;
+	}
+
+	anzahl = abholen('z', werte, max);
+	if(zeiten != NULL) {
+		for(int i = 0; i < anzahl; i++) {
+			zeiten[i] = (erfassungIndex + i) * erfassungIntervall;
+		}
+	}
+	erfassungIndex += anzahl;
+
+	return anzahl;
+}
+
+/**
+ * @brief Zustand der Erfassung abfragen
+ *
+ * @return 0 wenn die Erfassung beendet ist, sonst #ERFASSUNG_WARTET oder
+ *         #ERFASSUNG_LAEUFT; #ERFASSUNG_UEBERLAUF, falls Werte verloren
+ *         gegangen sind; -1 bei Fehler
+ * @see Erfassung
+ */
+int port_erfassung_zustand(void) {
+
+	char befehl[2];
+	char puffer[2];
+
+	if(!adapter_kann(FAEHIG_ERFASSUNG)) {
+		return -1;
+	}
+
+	befehl[0] = 'Z';
+	befehl[1] = 'Z';
+
+	uebertragung(befehl, 2, puffer, 2);
+	if(puffer[0] != befehl[0]) {
+		fprintf(stderr, "port_erfassung_zustand: Lesen der Antwort fehlgeschlagen! Erwartet: '%cx', bekommen '%c%c'!\n",
+						befehl[0], puffer[0], puffer[1]);
+		return -1;
+	}
+
+	return (unsigned char) puffer[1];
+}
+
+/**
+ * @brief Beliebigen I2C-Takt einstellen bzw. abfragen
+ *
+ * Der Mikrocontroller wählt Teiler und Vorteiler so, dass der Takt
+ * möglichst nah am Wunschwert liegt (zwischen etwa 500Hz und 400kHz),
+ * und meldet den tatsächlich erreichten Takt zurück.
+ *
+ * @param hz gewünschter Takt in Hz (max. 0xFFFFFF), 0 fragt nur ab
+ * @return tatsächlich eingestellter Takt in Hz, 0 bei Fehler
+ * @warning Nur mit dem I2C-Micro möglich!
+ */
+unsigned long i2c_takt(unsigned long hz) {
+
+	char befehl[4];
+	char puffer[4];
+
+	if(!adapter_kann(FAEHIG_TAKT)) {
+		return 0;
+	}
+
+	if(hz > 0xFFFFFF) {
+		hz = 0xFFFFFF;
+	}
+
+	befehl[0] = 'K';
+	befehl[1] = (char) ((hz >> 16) & 0xFF);
+	befehl[2] = (char) ((hz >> 8) & 0xFF);
+	befehl[3] = (char) (hz & 0xFF);
+
+	uebertragung(befehl, 4, puffer, 4);
+	if(puffer[0] != befehl[0]) {
+		fprintf(stderr, "i2c_takt: Lesen der Antwort fehlgeschlagen! Erwartet: '%c', bekommen '%c'!\n",
+						befehl[0], puffer[0]);
+		return 0;
+	}
+
+	return ((unsigned long) (unsigned char) puffer[1] << 16)
+			| ((unsigned long) (unsigned char) puffer[2] << 8)
+			| (unsigned char) puffer[3];
+}
+
+/**
+ * @brief Bus und serielle Verbindung für den aufrufenden Thread reservieren
+ *
+ * Die Funktionen dieser Library sind nicht threadsicher. Greift mehr als
+ * ein Thread auf den Adapter zu (z.B. der GPS-Lesethread aus gpsleser.c
+ * und das Display im Hauptprogramm), muss jeder Thread eine vollständige
+ * Übertragung von #start_iic bis #stop_iic bzw. einen Befehl wie
+ * #ublox_abholen zwischen #bus_sperren und #bus_freigeben ausführen.
+ * Gepostete Befehle müssen vor dem Freigeben abgeschlossen sein.
+ *
+ * Die Sperre ist nicht rekursiv.
+ */
+void bus_sperren(void) {
+	pthread_mutex_lock(&busSperre);
+}
+
+/**
+ * @brief Mit #bus_sperren reservierten Bus wieder freigeben
+ */
+void bus_freigeben(void) {
+	pthread_mutex_unlock(&busSperre);
+}
+
 /**
  * @brief Verzögerungs-Funktion, nicht Teil der offiziellen Library
  */
@@ -31,6 +31,182 @@
 #define SCL45 'B'  /*!< SCL 45kHz */
 #define SCL11 'C'  /*!< SCL 11kHz */
 #define SCL1_5 'D' /*!< SCL 1.5kHz */
+#define SCL100 'E' /*!< SCL 100kHz (Standard-Mode), nur I2C-Micro */
+#define SCL400 'F' /*!< SCL 400kHz (Fast-Mode), nur I2C-Micro */
+#define SCL1000 'G' /*!< SCL 1MHz (Fast-Mode Plus), vom I2C-Micro nicht unterstützt */
+
+/**
+ * @brief Maximale Anzahl an Zeichen pro HD44780-Befehl ('H')
+ *
+ * Der Empfangspuffer des Mikrocontrollers ist begrenzt, längere
+ * Zeichenketten werden von #hd44780_schreiben aufgeteilt.
+ */
+#define HD44780_MAX 32
+
+/**
+ * @brief Maximale Anzahl an Bytes pro Abholbefehl ('F')
+ *
+ * Im ursprünglichen Protokoll sind bis zu 255 Bytes pro Befehl möglich,
+ * im Protokoll v2 muss die Antwort in einen Rahmen passen.
+ * @see ublox_abholen
+ */
+#define UBLOX_ABHOLEN_MAX 255
+#define UBLOX_RAHMEN_MAX 32
+
+/**
+ * @brief Plätze für u-blox-Module, die der Adapter im Hintergrund abfragt
+ * @see ublox_hintergrund_platz
+ */
+#define UBLOX_MODULE 4
+
+/**
+ * @defgroup Programm Gespeicherte Programme
+ * @{
+ * Wiederkehrende Abläufe (z.B. Sensorabfragen) können als Programm in den
+ * I2C-Micro geladen und dort ohne Umweg über den Host ausgeführt werden.
+ * Jede Operation beginnt mit einem Befehlsbyte, gefolgt von ihren
+ * Parametern. Gelesene Bytes, Marken und Status landen im
+ * Ergebnispuffer des Adapters.
+ *
+ * Beispiel: Bytezahl eines u-blox-Moduls jede Sekunde lesen
+ *
+ *     char p[] = { PRG_MARKE, 0xAA, PRG_SCHREIBEN_OS, UBLOX_ADR, 1, 0xFD,
+ *                  PRG_BEI_NACK, 3, PRG_LESEN, UBLOX_ADR, 2 };
+ *     programm_laden(p, sizeof(p));
+ *     programm_periodisch(1000);
+ *
+ * @see programm_laden
+ * @see programm_ausfuehren
+ * @see programm_periodisch
+ * @see programm_ergebnisse
+ */
+#define PROGRAMM_MAX 128     /*!< max. Länge eines Programms */
+#define PROGRAMM_STUECK 32   /*!< Bytes pro Ladebefehl ('M') */
+#define PROGRAMM_EINMAL 0xFF /*!< 'J': Programm sofort einmal ausführen */
+#define PROGRAMM_TAKT 10     /*!< Einheit der Periode in ms */
+
+#define PRG_SCHREIBEN 'W'   /*!< 'W' adr n daten...: n Bytes (max. 32) schreiben, dann Stop */
+#define PRG_SCHREIBEN_OS 'w'/*!< 'w' adr n daten...: schreiben ohne Stop (für Restart) */
+#define PRG_LESEN 'R'       /*!< 'R' adr n: n Bytes (max. 32) lesen und ins Ergebnis legen */
+#define PRG_WARTEN 'Z'      /*!< 'Z' ms: warten (blockiert den Adapter!) */
+#define PRG_SCHLEIFE 'L'    /*!< 'L' n: folgenden Block bis 'E' n-mal ausführen (mind. einmal) */
+#define PRG_SCHLEIFE_ENDE 'E'
+#define PRG_BEI_NACK 'N'    /*!< 'N' k: nach einem NACK k Bytes überspringen */
+#define PRG_MARKE 'M'       /*!< 'M' wert: Byte ins Ergebnis legen */
+#define PRG_STATUS 'S'      /*!< 'S': Status des letzten Zugriffs (0 oder #AD0LRB) ins Ergebnis */
+#define PRG_ENDE 'X'        /*!< 'X': Programm beenden */
+/** @} */
+
+/**
+ * @defgroup Welle Wertefolgen am IO-Port
+ * @{
+ * Statt jeden Wert einzeln mit #wr_byte_port zu schreiben, werden die
+ * Werte in den Adapter geladen und dort per Timer in festem Abstand
+ * ausgegeben, unabhängig von der Latenz der USB-Verbindung. Im
+ * Streaming-Betrieb wird jeder Wert einmal ausgegeben und
+ * #port_welle_laden wartet, bis im Puffer des Adapters wieder Platz
+ * ist. Im Wiederholbetrieb läuft der Puffer endlos im Kreis.
+ *
+ * @see port_welle_laden
+ * @see port_welle_starten
+ * @see port_welle_stoppen
+ */
+#define WELLE_MAX 32            /*!< Werte pro Ladebefehl ('w') */
+#define WELLE_INTERVALL_MIN 20  /*!< kleinster Abstand in µs */
+#define WELLE_STREAMING 0
+#define WELLE_WIEDERHOLEN 1
+/** @} */
+
+/**
+ * @defgroup Erfassung Erfassung am IO-Port
+ * @{
+ * Der Adapter tastet den IO-Port in festem Abstand ab, auf Wunsch erst
+ * ab einem Triggermuster, und puffert bis zu 255 Werte. Mit
+ * #port_erfassung_abholen können die Werte schon während der Erfassung
+ * abgeholt werden, dann sind auch längere Aufzeichnungen möglich. Die
+ * Zeitstempel ergeben sich aus dem Intervall, gezählt ab dem Trigger.
+ * Läuft der Puffer über, endet die Erfassung (#ERFASSUNG_UEBERLAUF).
+ *
+ * Der Puffer wird mit den Wertefolgen geteilt, beides gleichzeitig geht
+ * nicht.
+ *
+ * @see port_erfassung_starten
+ * @see port_erfassung_abholen
+ * @see port_erfassung_zustand
+ */
+#define ERFASSUNG_WARTET (1 << 0)    /*!< Trigger noch nicht erkannt */
+#define ERFASSUNG_LAEUFT (1 << 1)    /*!< Erfassung läuft */
+#define ERFASSUNG_UEBERLAUF (1 << 2) /*!< Puffer übergelaufen, Erfassung beendet */
+/** @} */
+
+/**
+ * @defgroup ProtokollV2 Protokoll v2
+ * @{
+ * Gerahmte Befehle mit Sequenznummer und CRC, nur vom I2C-Micro
+ * unterstützt. Jeder Rahmen ist aufgebaut als
+ *
+ *     V2_START | Sequenznummer | Länge | Nutzdaten | CRC (High, Low)
+ *
+ * Die Nutzdaten sind ein Befehl bzw. eine Antwort des ursprünglichen
+ * Protokolls, die CRC (CRC-16/CCITT, Startwert 0xFFFF) läuft über
+ * Sequenznummer, Länge und Nutzdaten. Bis zu #V2_FENSTER Befehle dürfen
+ * unbeantwortet sein. Ist in der Länge #V2_NAK gesetzt, fordert der
+ * Mikrocontroller die Wiederholung eines Befehls an.
+ *
+ * @see protokoll_v2
+ */
+#define V2_START 0xA5                      /*!< Startbyte eines Rahmens */
+#define V2_NAK 0x80                        /*!< Wiederholungsanforderung */
+#define V2_KOPF 5                          /*!< Startbyte, Sequenznummer, Länge und CRC */
+#define V2_FENSTER 4                       /*!< max. Anzahl unbeantworteter Befehle */
+#define V2_NUTZDATEN_MAX (4 + HD44780_MAX) /*!< längster Befehl ('H') */
+#define V2_VERSUCHE 5                      /*!< Wiederholungen, bevor abgebrochen wird */
+#define V2_TIMEOUT 100                     /*!< Timeout in ms, danach wird wiederholt */
+/** @} */
+
+/**
+ * @defgroup Faehigkeiten Fähigkeiten des Adapters
+ * @{
+ * #Init fragt mit 'Q' ab, welche Erweiterungen der Adapter kennt, und
+ * nutzt automatisch den schnellsten verfügbaren Weg (Protokoll v2,
+ * HD44780-Befehle im Adapter, u-blox-Abfrage im Hintergrund). Das
+ * ursprüngliche USB-ITS-Gerät antwortet nicht auf 'Q', dann werden nur
+ * die ursprünglichen Befehle verwendet.
+ *
+ * @see adapter_info
+ * @see adapter_kann
+ */
+#define FAEHIG_V2 (1 << 0)       /*!< Protokoll v2 */
+#define FAEHIG_HD44780 (1 << 1)  /*!< HD44780-Befehle im Adapter ('H') */
+#define FAEHIG_UBLOX (1 << 2)    /*!< u-blox-Abfrage im Hintergrund ('G', 'F') */
+#define FAEHIG_TAKT (1 << 3)     /*!< beliebiger Takt ('K') */
+#define FAEHIG_PROGRAMM (1 << 4) /*!< gespeicherte Programme ('M', 'J', 'I') */
+#define FAEHIG_WELLE (1 << 5)    /*!< Ausgabe von Wertefolgen am IO-Port ('w', 'Y') */
+#define FAEHIG_ERFASSUNG (1 << 6)/*!< Erfassung am IO-Port ('d', 'z', 'Z') */
+#define FAEHIG_UBLOX_MEHR (1 << 7)/*!< mehrere u-blox-Module im Hintergrund ('g', 'f') */
+#define FAEHIGKEITEN_LAENGE 18   /*!< Länge der Antwort auf 'Q' ohne Kopf */
+#define FAEHIGKEITEN_TIMEOUT 200 /*!< Timeout der Abfrage in ms */
+
+/**
+ * @brief Beschreibung des angeschlossenen Adapters
+ */
+typedef struct {
+	bool i2cMicro;                /*!< false: ursprüngliches USB-ITS-Gerät */
+	unsigned char version;        /*!< Protokollversion, 1 beim USB-ITS-Gerät */
+	unsigned short merkmale;      /*!< FAEHIG_... */
+	unsigned long baudrate;
+	unsigned char takte;          /*!< Bit i für SCL-Code 'A'+i */
+	unsigned long takt;           /*!< eingestellter I2C-Takt in Hz */
+	unsigned short rxPuffer;      /*!< Größe des Empfangspuffers */
+	unsigned short txPuffer;      /*!< Größe des Sendepuffers */
+	unsigned short ubloxPuffer;   /*!< Größe des u-blox-Puffers */
+	unsigned char programmMax;    /*!< max. Länge eines Programms */
+	unsigned short ergebnisPuffer;/*!< Größe des Ergebnispuffers */
+	unsigned char hd44780Max;     /*!< max. Zeichen pro HD44780-Befehl */
+	unsigned char v2Fenster;      /*!< Fenstergröße im Protokoll v2 */
+	unsigned int sitzung;         /*!< zählt die Aufrufe von #Init, danach ist der Zustand im Adapter gelöscht */
+} adapterInfo;
+/** @} */
 
 /**
  * @defgroup Busstatus Busstatus-Rückgabewert für I2C-Befehle
@@ -114,6 +290,7 @@ extern void serialDump(void);
 extern char start_iic(bool MRX_ACK, char dest, char mode);
 extern char stop_iic(void);
 extern char wr_byte_iic(char b);
+extern char wr_bytes_iic(char* b, unsigned int laenge);
 extern char rd_byte_iic(char* b, bool NOACK);
 extern char restart_iic(bool MRX_ACK, char dest, char mode);
 extern void wr_byte_port(char zuSchreiben);
@@ -125,6 +302,32 @@ extern void led_on(void);
 extern void led_off(void);
 extern void delay(unsigned int mseconds);
 extern void delayMicroseconds(unsigned int micros);
+extern void bus_sperren(void);
+extern void bus_freigeben(void);
+
+// Erweiterte Befehle des I2C-Micro (nicht im USB-ITS-Gerät vorhanden)
+extern const adapterInfo* adapter_info(void);
+extern bool adapter_kann(unsigned short merkmal);
+extern bool protokoll_v2(bool aktiv);
+extern bool ublox_hintergrund(char adr);
+extern int ublox_abholen(char* puffer, unsigned int max);
+extern bool ublox_hintergrund_platz(unsigned char platz, char adr);
+extern int ublox_abholen_platz(unsigned char platz, char* puffer, unsigned int max);
+extern bool hd44780_unterstuetzt(void);
+extern char hd44780_schreiben(char adr, char modus, char* daten, unsigned int laenge);
+extern void hd44780_posten(char adr, char modus, char* daten, unsigned int laenge);
+extern char hd44780_abschliessen(void);
+extern unsigned long i2c_takt(unsigned long hz);
+extern bool programm_laden(char* programm, unsigned int laenge);
+extern char programm_ausfuehren(void);
+extern bool programm_periodisch(unsigned int ms);
+extern int programm_ergebnisse(char* puffer, unsigned int max);
+extern bool port_welle_laden(char* werte, unsigned int anzahl);
+extern bool port_welle_starten(unsigned int intervall, bool wiederholen);
+extern bool port_welle_stoppen(void);
+extern bool port_erfassung_starten(unsigned int intervall, char maske, char wert, unsigned int anzahl);
+extern int port_erfassung_abholen(char* werte, unsigned long* zeiten, unsigned int max);
+extern int port_erfassung_zustand(void);
 
 // Funktionen zur Debug-Ausgabe
 extern void decodeStatus(unsigned char status);
@@ -152,6 +152,31 @@ int sende_befehl(int fd, char* befehl) {
 	return rueckgabe;
 }
 
+/**
+ * @brief Sendet n Zeichen über die serielle Schnittstelle
+ *
+ * Wird für die Befehle mit variabler Länge benötigt, alle anderen
+ * Befehle bestehen aus zwei Zeichen und nutzen #sende_befehl.
+ *
+ * @param fd Filedeskriptor von geöffnetem seriellen Port
+ * @param daten Zeiger auf zu sendende Daten
+ * @param laenge Anzahl der zu sendenden Bytes
+ * @return Anzahl gesendeter Zeichen
+ */
+int sende_daten(int fd, char* daten, int laenge) {
+	int rueckgabe = write(fd, daten, laenge);
+
+#if DEBUG
+	printf("Sende Daten: %c..., gesendete Bytes (soll/ist): %d/%d\n", daten[0], laenge, rueckgabe);
+#endif
+
+	if(rueckgabe != laenge) {
+		fprintf(stderr, "sende_daten: Senden der Daten fehlgeschlagen!\n");
+	}
+
+	return rueckgabe;
+}
+
 /**
  * @brief Liest n Zeichen von der seriellen Schnittstelle
  * @param fd Filedeskriptor von geöffnetem seriellen Port
@@ -163,7 +188,9 @@ int sende_befehl(int fd, char* befehl) {
  *
  */
 int lese_antwort(int fd, char* puffer, int laenge) {
-	int gelesene_bytes = read(fd, puffer, laenge);
+	// read kann weniger Bytes liefern, wenn die Antwort in mehreren
+	// USB-Paketen ankommt, daher bis zum Timeout weiterlesen
+	int gelesene_bytes = lese_daten(fd, puffer, laenge);
 
 #if DEBUG
 	printf("Gelesene Bytes (soll/ist): %d/%d: %c%c%c\n", laenge, gelesene_bytes,
@@ -177,6 +204,64 @@ int lese_antwort(int fd, char* puffer, int laenge) {
 	return gelesene_bytes;
 }
 
+/**
+ * @brief Liest genau n Zeichen von der seriellen Schnittstelle
+ *
+ * Anders als #lese_antwort wird so lange gelesen, bis alle Bytes da
+ * sind oder das Timeout des Ports abgelaufen ist. Es werden keine
+ * Fehlermeldungen ausgegeben, das Auswerten übernimmt der Aufrufer.
+ *
+ * @param fd Filedeskriptor von geöffnetem seriellen Port
+ * @param puffer Puffer für zu lesende Zeichen, mindestens laenge Bytes
+ * @param laenge Anzahl der zu lesenden Bytes
+ * @return Anzahl gelesener Bytes, kleiner als laenge bei Timeout
+ */
+int lese_daten(int fd, char* puffer, int laenge) {
+	int gelesene_bytes = 0;
+	int n;
+
+	while(gelesene_bytes < laenge) {
+		n = read(fd, puffer + gelesene_bytes, laenge - gelesene_bytes);
+		if(n <= 0) {
+			break; // Timeout (VTIME) oder Fehler
+		}
+		gelesene_bytes += n;
+	}
+
+	return gelesene_bytes;
+}
+
+/**
+ * @brief Setzt das Timeout für Lesezugriffe
+ *
+ * termios kennt nur Zehntelsekunden, kürzere Zeiten werden aufgerundet.
+ *
+ * @param fd Filedeskriptor von geöffnetem seriellen Port
+ * @param ms Timeout in Millisekunden
+ */
+void setze_timeout(int fd, int ms) {
+	struct termios seriell;
+
+	if(tcgetattr(fd, &seriell) != 0) {
+		fprintf(stderr, "Fehler %d beim Lesen der Attribute von termios Struktur\n", errno);
+		return;
+	}
+
+	seriell.c_cc[VTIME] = (ms + 99) / 100;
+
+	if(tcsetattr(fd, TCSANOW, &seriell) != 0) {
+		fprintf(stderr, "Fehler %d beim Schreiben der Attribute von termios Struktur\n", errno);
+	}
+}
+
+/**
+ * @brief Verwirft alle empfangenen, noch nicht gelesenen Zeichen
+ * @param fd Filedeskriptor von geöffnetem seriellen Port
+ */
+void leere_puffer(int fd) {
+	tcflush(fd, TCIFLUSH);
+}
+
 /**
  * @brief Terminierung des Programms
  *
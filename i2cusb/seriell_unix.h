@@ -60,7 +60,11 @@
 // Funktionen
 extern int oeffne_port(int fd, int port);
 extern int sende_befehl(int fd, char* befehl);
+extern int sende_daten(int fd, char* daten, int laenge);
 extern int lese_antwort(int fd, char* puffer, int laenge);
+extern int lese_daten(int fd, char* puffer, int laenge);
+extern void setze_timeout(int fd, int ms);
+extern void leere_puffer(int fd);
 extern void err_quit(int fd);
 
 #endif // SERIELL_UNIX_H_
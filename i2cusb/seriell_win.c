@@ -110,6 +110,39 @@ HANDLE sende_befehl(HANDLE fd, char* befehl) {
 	return fd;
 }
 
+/**
+ * @brief Sendet n Zeichen ber die serielle Schnittstelle
+ *
+ * Wird fr die Befehle mit variabler Lnge bentigt, alle anderen
+ * Befehle bestehen aus zwei Zeichen und nutzen #sende_befehl.
+ *
+ * @param fd Filedeskriptor von geffnetem seriellen Port
+ * @param daten Zeiger auf zu sendende Daten
+ * @param laenge Anzahl der zu sendenden Bytes
+ * @return Filedeskriptor
+ */
+HANDLE sende_daten(HANDLE fd, char* daten, int laenge) {
+	DWORD gesendete_bytes = 0;
+
+	if(WriteFile(fd, daten, laenge, &gesendete_bytes, NULL) == false) {
+        fprintf(stderr, "sende_daten: Senden der Daten fehlgeschlagen!\n");
+        CloseHandle(fd);
+        //return -1;
+	}
+
+#if DEBUG
+	printf("Sende Daten: %c..., gesendete Bytes (soll/ist): %d/%lu\n", daten[0], laenge, gesendete_bytes);
+#endif
+
+	if(gesendete_bytes != (unsigned long) laenge) {
+		fprintf(stderr, "sende_daten: Senden der Daten fehlgeschlagen! Zu wenig Daten gesendet!\n");
+        CloseHandle(fd);
+        //return -1;
+	}
+
+	return fd;
+}
+
 /**
  * @brief Liest n Zeichen von der seriellen Schnittstelle
  * @param fd Filedeskriptor von geffnetem seriellen Port
@@ -145,6 +178,56 @@ HANDLE lese_antwort(HANDLE fd, char* puffer, int laenge) {
     return fd;
 }
 
+/**
+ * @brief Liest genau n Zeichen von der seriellen Schnittstelle
+ *
+ * Anders als #lese_antwort werden keine Fehlermeldungen ausgegeben,
+ * das Auswerten bernimmt der Aufrufer. ReadFile wartet bis alle Bytes
+ * da sind oder die Timeouts des Ports abgelaufen sind.
+ *
+ * @param fd Filedeskriptor von geffnetem seriellen Port
+ * @param puffer Puffer fr zu lesende Zeichen, mindestens laenge Bytes
+ * @param laenge Anzahl der zu lesenden Bytes
+ * @return Anzahl gelesener Bytes, kleiner als laenge bei Timeout
+ */
+int lese_daten(HANDLE fd, char* puffer, int laenge) {
+    DWORD gelesene_bytes = 0;
+
+    if(ReadFile(fd, puffer, laenge, &gelesene_bytes, NULL) == FALSE) {
+        return 0;
+    }
+
+    return (int) gelesene_bytes;
+}
+
+/**
+ * @brief Setzt das Timeout fr Lesezugriffe
+ * @param fd Filedeskriptor von geffnetem seriellen Port
+ * @param ms Timeout in Millisekunden
+ */
+void setze_timeout(HANDLE fd, int ms) {
+    COMMTIMEOUTS timeouts = {0};
+
+    if(GetCommTimeouts(fd, &timeouts) == 0) {
+        fprintf(stderr, "Fehler beim Lesen der Timeouts!\n");
+        return;
+    }
+
+    timeouts.ReadIntervalTimeout = ms;
+    timeouts.ReadTotalTimeoutConstant = ms;
+    if(SetCommTimeouts(fd, &timeouts) == 0) {
+        fprintf(stderr, "Fehler beim Setzen der Timeouts!\n");
+    }
+}
+
+/**
+ * @brief Verwirft alle empfangenen, noch nicht gelesenen Zeichen
+ * @param fd Filedeskriptor von geffnetem seriellen Port
+ */
+void leere_puffer(HANDLE fd) {
+    PurgeComm(fd, PURGE_RXCLEAR);
+}
+
 /**
  * @brief Terminierung des Programms
  * Diese Funktion schliet den Filedeskriptor und beendet dann das Programm
@@ -38,7 +38,11 @@
 // Funktionen
 extern HANDLE oeffne_port(HANDLE fd, int port);
 extern HANDLE sende_befehl(HANDLE fd, char* befehl);
+extern HANDLE sende_daten(HANDLE fd, char* daten, int laenge);
 extern HANDLE lese_antwort(HANDLE fd, char* puffer, int laenge);
+extern int lese_daten(HANDLE fd, char* puffer, int laenge);
+extern void setze_timeout(HANDLE fd, int ms);
+extern void leere_puffer(HANDLE fd);
 extern void err_quit(HANDLE fd);
 
 
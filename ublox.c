@@ -14,10 +14,36 @@
  */
 
 #include <stdbool.h>
+#include <string.h>
 
 #include "ublox.h"
+#include "ubx.h"
+#include "aufzeichnung.h"
 #include "i2cusb/i2cusb.h"
 
+/**
+ * Adressen der Module, die der Adapter im Hintergrund abfragt
+ * (#startPollUblox), je Platz im Adapter, 0 wenn keins.
+ */
+char abfrageAdressen[UBLOX_MODULE] = {0};
+
+/**
+ * Sitzung des Adapters (#adapterInfo), zu der abfrageAdressen gehrt.
+ * Das 'XX' in #Init beendet die Abfragen im Adapter.
+ */
+unsigned int abfrageSitzung = 0;
+
+/**
+ * Das Modul mit der Adresse #UBLOX_ADR, fr writeUblox, drainUblox usw.
+ * Sein Datenstrom wird aufgezeichnet (#aufzeichnung_starten).
+ */
+ublox ubloxStandard = { .adr = UBLOX_ADR, .aufzeichnen = true };
+
+/**
+ * Laufende Nummer der Zugriffe durch #ublox_reihum
+ */
+unsigned long reihumZugriffe = 0;
+
 /**
  * @brief Interne Funktion zum Initialisieren des I2C-Busses fr
  * einen Lesevorgang vom NEO-7M Modul.
@@ -29,36 +55,32 @@
  *
  * Danach folgt der eigentliche Lesevorgang.
  *
+ * @param slave I2C-Adresse des Moduls
  * @param adr die zu lesende Registeradresse
  * @return 0 bei erfolgreicher Ausfhrung, -1 bei Fehler
  */
-int initRead(char adr) {
+int initRead(char slave, char adr) {
     // Speicher fr Rckgabewert
     char rueck;
 
     // Startcondition auf dem Bus erzeugen, um Registeradresse zu schreiben
-    rueck = start_iic(false, UBLOX_ADR, 'w');
+    rueck = start_iic(false, slave, 'w');
 
     // kein Ack-Bit
-    if(!(rueck & AD0LRB)) {
+    if(rueck & AD0LRB) {
         fprintf(stderr, "initRead: Kein Acknowledge empfangen!\n");
         return -1;
     }
 
-    // zu lesendes Register auf den Bus schreiben
-    rueck = wr_byte_iic(adr);
-
-    // kein Ack-Bit empfangen
-    if(!(rueck & AD0LRB)) {
-        fprintf(stderr, "initRead: Kein Acknowledge empfangen!\n");
-        return -1;
-    }
+    // zu lesendes Register auf den Bus schreiben, die Antwort auf 'N'
+    // ist das gesendete Byte und enthlt keinen Busstatus
+    wr_byte_iic(adr);
 
     // Startcondition auf dem Bus erzeugen, um Registerinhalt zu lesen
-    rueck = restart_iic(false, UBLOX_ADR, 'r');
+    rueck = restart_iic(false, slave, 'r');
 
     // kein Ack-Bit
-    if(!(rueck & AD0LRB)) {
+    if(rueck & AD0LRB) {
         fprintf(stderr, "initRead: Kein Acknowledge empfangen!\n");
         return -1;
     }
@@ -88,7 +110,7 @@ int randomReadUblox(char adr, char* buffer, unsigned int length) {
     }
 
     // I2C-Bus initialisieren
-    if(initRead(adr) == -1) {
+    if(initRead(UBLOX_ADR, adr) == -1) {
         fprintf(stderr, "randomReadUblox: Initialisierung fehlgeschlagen!\n");
         return -1;
     }
@@ -103,7 +125,7 @@ int randomReadUblox(char adr, char* buffer, unsigned int length) {
         } else {
             rueck = rd_byte_iic(buffer+i , false);
             // kein Ack-Bit
-            if(!(rueck & AD0LRB)) {
+            if(rueck & AD0LRB) {
                 fprintf(stderr, "randomReadUblox: Kein Acknowledge beim Lesen von Byte %d/%d empfangen!\n", i, length);
                 return -1;
             }
@@ -119,43 +141,570 @@ int randomReadUblox(char adr, char* buffer, unsigned int length) {
 /**
  * @brief Funktion zum Schreiben von zwei oder mehr Bytes in das NEO-7M Modul
  *
+ * Wie #ublox_schreiben fr #ubloxStandard.
+ *
+ * @param b Puffer fr die zu scrheibenden Daten
+ * @param length Anzahl der zu schreibenden Bytes
+ * @return 0 bei erfolgreicher Ausfhrung, -1 im Fehlerfall
+ */
+int writeUblox(char* b, int length) {
+    return ublox_schreiben(&ubloxStandard, b, length);
+}
+
+/**
+ * @brief Funktion zum Schreiben von zwei oder mehr Bytes in ein NEO-7M Modul
+ *
  * Diese Funktion schreibt zwei Bytes oder mehr in das NEO-7M Modul.
  * Auf einzelne Register besteht kein Schreibzugriff, es knnen also nur
  * UBX- oder NMEA-Befehle geschrieben werden.
  * Die Bytezahl muss mindestens zwei sein, damit das Modul den Schreibzugriff
  * vom Schreiben der Registeradresse beim Lesezugriff unterscheiden kann.
  *
+ * Lngere Nachrichten werden auf mehrere Transaktionen von hchstens
+ * #UBLOX_SCHREIBEN_MAX Bytes verteilt, das Modul setzt den Datenstrom
+ * wieder zusammen. Dabei bleibt jedes Stck mindestens zwei Bytes lang.
+ *
+ * @param u Empfnger
  * @param b Puffer fr die zu scrheibenden Daten
  * @param length Anzahl der zu schreibenden Bytes
  * @return 0 bei erfolgreicher Ausfhrung, -1 im Fehlerfall
  */
-int writeUblox(char* b, int length) {
+int ublox_schreiben(ublox* u, char* b, int length) {
     // die Lnge der zu schreibenden Bytes muss mindestens 2 sein
     if(length < 2) {
-        fprintf(stderr, "writeUblox: Mindestlnge fr Schreibzugriffe betrgt 2 Bytes!\n");
+        fprintf(stderr, "ublox_schreiben: Mindestlnge fr Schreibzugriffe betrgt 2 Bytes!\n");
         return -1;
     }
 
     // Speicher fr Rckgabewert
     char rueck;
 
-    // Startcondition auf dem Bus erzeugen, um Registeradresse zu schreiben
-    rueck = start_iic(true, UBLOX_ADR, 'w');
+    while(length > 0) {
+        int stueck = length > UBLOX_SCHREIBEN_MAX ? UBLOX_SCHREIBEN_MAX : length;
 
-    // kein Ack-Bit
-    if(!(rueck & AD0LRB)) {
-        fprintf(stderr, "writeUblox: Kein Ack bei Startcondition empfangen!\n");
+        // kein einzelnes Byte brig lassen
+        if(length - stueck == 1) {
+            stueck--;
+        }
+
+        // Startcondition auf dem Bus erzeugen, um Registeradresse zu schreiben
+        rueck = start_iic(true, u->adr, 'w');
+
+        // kein Ack-Bit
+        if(rueck & AD0LRB) {
+            fprintf(stderr, "ublox_schreiben: Kein Ack von 0x%02X bei Startcondition empfangen!\n",
+                    u->adr & 0xFF);
+            u->fehler++;
+            return -1;
+        }
+
+        // die Antwort auf 'N' ist das gesendete Byte und enthlt keinen
+        // Busstatus, ob das Modul die Nachricht angenommen hat, zeigt erst
+        // die Antwort im Datenstrom (siehe configUblox)
+        wr_bytes_iic(b, stueck);
+
+        stop_iic();
+
+        b += stueck;
+        length -= stueck;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Interne Funktion, vergisst die Pltze einer frheren Sitzung
+ *
+ * Nach einem erneuten #Init fragt der Adapter keine Module mehr ab, die
+ * Pltze werden dann beim nchsten Zugriff neu belegt.
+ */
+void abfrageAbgleichen(void) {
+    if(abfrageSitzung != adapter_info()->sitzung) {
+        memset(abfrageAdressen, 0, sizeof(abfrageAdressen));
+        abfrageSitzung = adapter_info()->sitzung;
+    }
+}
+
+/**
+ * @brief Interne Funktion, startet die Abfrage eines Moduls im Adapter
+ * @param platz Platz im Adapter
+ * @param adr I2C-Adresse des Moduls
+ * @return 0 bei erfolgreicher Ausfhrung, -1 im Fehlerfall
+ */
+int pollStarten(unsigned char platz, char adr) {
+    abfrageAbgleichen();
+    if(!ublox_hintergrund_platz(platz, adr)) {
+        fprintf(stderr, "pollStarten: Adapter untersttzt keine Abfrage im Hintergrund!\n");
         return -1;
     }
 
-    for(int i = 0; i < length; i++) {
-        rueck = wr_byte_iic(*(b+i));
-        if(!(rueck & AD0LRB)) {
-            fprintf(stderr, "writeUblox: Kein Ack bei Schreibvorgang empfangen!\n");
-            return -1;
+    abfrageAdressen[platz] = adr;
+    return 0;
+}
+
+/**
+ * @brief Interne Funktion, sucht den Platz eines Moduls im Adapter
+ *
+ * Wird das Modul noch nicht im Hintergrund abgefragt, bekommt es den
+ * ersten freien Platz. Ohne #FAEHIG_UBLOX_MEHR gibt es nur Platz 0.
+ *
+ * @param adr I2C-Adresse des Moduls
+ * @return Platz, -1 falls keiner frei ist, -2 im Fehlerfall
+ */
+int pollPlatz(char adr) {
+    int plaetze = adapter_kann(FAEHIG_UBLOX_MEHR) ? UBLOX_MODULE : 1;
+
+    abfrageAbgleichen();
+    for(int i = 0; i < plaetze; i++) {
+        if(abfrageAdressen[i] == adr) {
+            return i;
+        }
+    }
+    for(int i = 0; i < plaetze; i++) {
+        if(abfrageAdressen[i] == 0) {
+            return pollStarten(i, adr) == 0 ? i : -2;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Funktion zum Starten der Abfrage des NEO-7M Moduls im Adapter
+ *
+ * Statt jedes Byte einzeln vom Host aus zu lesen, fragt der
+ * Mikrocontroller des Adapters das Modul selbststndig ab und sammelt
+ * den Datenstrom in einem Puffer. Die Daten werden mit #fetchUblox
+ * abgeholt.
+ *
+ * @return 0 bei erfolgreicher Ausfhrung, -1 im Fehlerfall
+ * @warning Nur mit dem I2C-Micro mglich!
+ */
+int startPollUblox(void) {
+    return pollStarten(0, UBLOX_ADR);
+}
+
+/**
+ * @brief Funktion zum Beenden der Abfrage der NEO-7M Module im Adapter
+ *
+ * Beendet auch die Abfrage weiterer Module (siehe #ublox_drain).
+ *
+ * @return 0 bei erfolgreicher Ausfhrung, -1 im Fehlerfall
+ */
+int stopPollUblox(void) {
+    for(int i = 1; i < UBLOX_MODULE; i++) {
+        if(abfrageAdressen[i] != 0) {
+            ublox_hintergrund_platz(i, 0);
+            abfrageAdressen[i] = 0;
+        }
+    }
+    abfrageAdressen[0] = 0;
+    return ublox_hintergrund(0) ? 0 : -1;
+}
+
+/**
+ * @brief Funktion zum Abholen der im Adapter gesammelten Daten
+ *
+ * @param buffer Puffer fr die abgeholten Daten
+ * @param max Gre des Puffers
+ * @return Anzahl der abgeholten Bytes
+ * @see startPollUblox
+ */
+int fetchUblox(char* buffer, unsigned int max) {
+    return ublox_abholen(buffer, max);
+}
+
+/**
+ * @brief Funktion zum Lesen aller im NEO-7M Modul bereitliegenden Bytes
+ *
+ * Wie #ublox_drain fr #ubloxStandard, luft eine Aufzeichnung
+ * (#aufzeichnung_starten), werden die Daten zustzlich dort angehngt.
+ * Bei gesperrtem Bus besser #ublox_drain und nach #bus_freigeben
+ * #ublox_aufzeichnen aufrufen.
+ *
+ * @param buffer Puffer fr die gelesenen Daten
+ * @param max Gre des Puffers
+ * @return Anzahl der gelesenen Bytes, -1 im Fehlerfall
+ */
+int drainUblox(char* buffer, unsigned int max) {
+    int gelesen = ublox_drain(&ubloxStandard, buffer, max);
+
+    ublox_aufzeichnen(&ubloxStandard, buffer, gelesen);
+    return gelesen;
+}
+
+/**
+ * @brief Funktion zum Lesen aller in einem NEO-7M Modul bereitliegenden Bytes
+ *
+ * Die Anzahl der bereitliegenden Bytes wird aus den Registern 0xFD/0xFE
+ * gelesen. Danach steht der Registerzeiger des Moduls auf 0xFF und bleibt
+ * dort, sodass die Daten in derselben Lesetransaktion folgen, ohne dass
+ * die Registeradresse noch einmal geschrieben wird. Passen nicht alle
+ * Bytes in den Puffer, bleibt der Rest im Modul und wird beim nchsten
+ * Aufruf gelesen.
+ *
+ * Kann der Adapter das Modul selbst abfragen (I2C-Micro), wird die
+ * Abfrage im Hintergrund beim ersten Aufruf gestartet und der Puffer
+ * des Adapters geleert. Der Mikrocontroller liest dabei genauso. Das
+ * geht fr bis zu #UBLOX_MODULE Module (mit #FAEHIG_UBLOX_MEHR, sonst
+ * fr eines), weitere werden direkt gelesen.
+ *
+ * Aufgezeichnet wird hier nicht, damit ein Zugriff mit gesperrtem Bus
+ * nicht auf die Platte wartet, siehe #ublox_aufzeichnen.
+ *
+ * @param u Empfnger
+ * @param buffer Puffer fr die gelesenen Daten
+ * @param max Gre des Puffers
+ * @return Anzahl der gelesenen Bytes, -1 im Fehlerfall
+ */
+int ublox_drain(ublox* u, char* buffer, unsigned int max) {
+    char anzahl[2];
+    unsigned int verfuegbar;
+    char rest;
+    int platz = adapter_kann(FAEHIG_UBLOX) ? pollPlatz(u->adr) : -1;
+
+    if(platz == -2) {
+        u->fehler++;
+        return -1;
+    }
+    if(platz >= 0) {
+        int gelesen = ublox_abholen_platz(platz, buffer, max);
+        if(gelesen > 0) {
+            u->bytes += gelesen;
         }
+        return gelesen;
+    }
+
+    if(max == 0) {
+        return 0;
+    }
+
+    // Registerzeiger auf die Anzahl setzen und Lesen starten
+    if(initRead(u->adr, (char) UBLOX_REG_ANZAHL) == -1) {
+        fprintf(stderr, "ublox_drain: Initialisierung von 0x%02X fehlgeschlagen!\n", u->adr & 0xFF);
+        stop_iic();
+        u->fehler++;
+        return -1;
+    }
+
+    // Dummyread, dann High- und Low-Byte der Anzahl
+    rd_byte_iic(anzahl, false);
+    rd_byte_iic(anzahl, false);
+    rd_byte_iic(anzahl+1, false);
+
+    verfuegbar = ((unsigned int) (unsigned char) anzahl[0] << 8) | (unsigned char) anzahl[1];
+
+    // 0xFFFF: das Modul hat gerade keine gltige Anzahl
+    if(verfuegbar == 0xFFFF) {
+        verfuegbar = 0;
+    }
+    if(verfuegbar > max) {
+        verfuegbar = max;
+    }
+
+    // der Lesevorgang muss mit einem negativen Acknowledge beendet werden
+    if(verfuegbar == 0) {
+        rd_byte_iic(&rest, true);
+        stop_iic();
+        return 0;
+    }
+
+    for(unsigned int i = 0; i < verfuegbar; i++) {
+        rd_byte_iic(buffer+i, i == verfuegbar-1);
+    }
+
+    stop_iic();
+
+    u->bytes += verfuegbar;
+
+    return verfuegbar;
+}
+
+/**
+ * @brief Gelesene Daten eines Empfngers an die laufende Aufzeichnung anhngen
+ *
+ * Nur wenn ublox::aufzeichnen gesetzt ist. Nach #ublox_drain aufrufen,
+ * wenn der Bus wieder freigegeben ist (#bus_freigeben).
+ *
+ * @param u Empfnger
+ * @param daten gelesene Daten
+ * @param anzahl Ergebnis von #ublox_drain, bei <= 0 passiert nichts
+ */
+void ublox_aufzeichnen(const ublox* u, const char* daten, int anzahl) {
+    if(u->aufzeichnen && anzahl > 0) {
+        aufzeichnung_anhaengen(daten, anzahl);
+    }
+}
+
+/**
+ * @brief Funktion zum Umschalten der DDC-Schnittstelle auf reine UBX-Ausgabe
+ *
+ * Im Binrmodus gibt das Modul am DDC-Port (I2C) keine NMEA-Stze mehr
+ * aus (CFG-PRT), sondern nur noch einmal pro Epoche NAV-PVT (CFG-MSG).
+ * Das sind etwa 100 statt mehrerer hundert Bytes pro Epoche, die mit
+ * #ubx_nav_pvt dekodiert werden. Eingaben nimmt der Port weiter in UBX
+ * und NMEA an. Ohne Binrmodus wird die NMEA-Ausgabe wieder eingeschaltet
+ * und NAV-PVT abgeschaltet.
+ *
+ * Die Einstellung gilt bis zum Neustart des Moduls, sie wird nicht
+ * im Modul gespeichert. Daten, die whrend der Umschaltung ankommen,
+ * werden verworfen.
+ *
+ * @param binaer true: nur UBX, false: wieder NMEA
+ * @return 0 bei erfolgreicher Ausfhrung, -1 im Fehlerfall
+ * @see ublox_binaer
+ */
+int binaryModeUblox(bool binaer) {
+    return ublox_binaer(&ubloxStandard, binaer);
+}
+
+/**
+ * @brief Ein beliebiges Modul auf reine UBX-Ausgabe umschalten
+ *
+ * Wie #binaryModeUblox.
+ *
+ * @param u Empfnger
+ * @param binaer true: nur UBX, false: wieder NMEA
+ * @return 0 bei erfolgreicher Ausfhrung, -1 im Fehlerfall
+ */
+int ublox_binaer(ublox* u, bool binaer) {
+    char prt[20] = {0};
+    char msg[3];
+    ubloxKonfig konfig[2] = {
+        {UBX_CFG, UBX_CFG_PRT, prt, sizeof(prt), UBLOX_OFFEN},
+        {UBX_CFG, UBX_CFG_MSG, msg, sizeof(msg), UBLOX_OFFEN}
+    };
+
+    // CFG-PRT fr den DDC-Port (0), Modus enthlt die Slave-Adresse
+    prt[4] = (char) (u->adr << 1);
+    prt[12] = 0x03;                 // inProtoMask: UBX und NMEA
+    prt[14] = binaer ? 0x01 : 0x03; // outProtoMask: nur UBX bzw. UBX und NMEA
+
+    // CFG-MSG mit drei Bytes: Rate fr die Schnittstelle, ber die es kommt
+    msg[0] = UBX_NAV;
+    msg[1] = UBX_NAV_PVT;
+    msg[2] = binaer ? 1 : 0;
+
+    if(ublox_konfig(u, konfig, 2, NULL) != 0) {
+        fprintf(stderr, "ublox_binaer: Umschaltung von 0x%02X wurde nicht besttigt!\n", u->adr & 0xFF);
+        return -1;
     }
 
     return 0;
 }
 
+/**
+ * @brief Interne Funktion, ordnet ACK-ACK/ACK-NAK den gesendeten Nachrichten zu
+ *
+ * Das Modul antwortet in der Reihenfolge der Nachrichten, eine Antwort
+ * gehrt also zur ersten noch offenen Nachricht mit derselben Klasse und ID.
+ */
+void ackZuordnen(unsigned char klasse, unsigned char id, const char* nutzdaten,
+                 unsigned int laenge, void* kontext) {
+    ubloxKonfig** lauf = (ubloxKonfig**) kontext;
+    ubloxKonfig* k = lauf[0];
+    ubloxKonfig* ende = lauf[1];
+
+    if(klasse != UBX_ACK || laenge < 2 || (id != UBX_ACK_ACK && id != UBX_ACK_NAK)) {
+        return;
+    }
+
+    for(; k < ende; k++) {
+        if(k->ergebnis == UBLOX_OFFEN && k->klasse == (unsigned char) nutzdaten[0]
+                && k->id == (unsigned char) nutzdaten[1]) {
+            k->ergebnis = (id == UBX_ACK_ACK) ? UBLOX_ANGENOMMEN : UBLOX_ABGELEHNT;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Funktion zum Senden mehrerer CFG-Nachrichten mit Besttigung
+ *
+ * Alle Nachrichten werden direkt hintereinander gesendet, danach wird der
+ * Datenstrom gelesen und jedes ACK-ACK bzw. ACK-NAK der passenden
+ * Nachricht zugeordnet. Nachrichten, die abgelehnt wurden oder nach
+ * #UBLOX_ACK_TIMEOUT ms noch keine Antwort haben, werden im nchsten
+ * Durchgang erneut gesendet, hchstens #UBLOX_VERSUCHE mal.
+ *
+ * Der whrend des Wartens gelesene Datenstrom geht zustzlich an den
+ * Parser weiter, sodass keine Daten verloren gehen.
+ *
+ * @param nachrichten zu sendende Nachrichten, das Ergebnis steht danach in
+ *     ubloxKonfig::ergebnis
+ * @param anzahl Anzahl der Nachrichten
+ * @param weiter Parser fr die brigen Daten, NULL falls nicht bentigt
+ * @return Anzahl der nicht angenommenen Nachrichten, -1 im Fehlerfall
+ * @see ublox_konfig
+ */
+int configUblox(ubloxKonfig* nachrichten, int anzahl, ubxParser* weiter) {
+    return ublox_konfig(&ubloxStandard, nachrichten, anzahl, weiter);
+}
+
+/**
+ * @brief Mehrere CFG-Nachrichten mit Besttigung an ein beliebiges Modul senden
+ *
+ * Wie #configUblox.
+ *
+ * @param u Empfnger
+ * @param nachrichten zu sendende Nachrichten
+ * @param anzahl Anzahl der Nachrichten
+ * @param weiter Parser fr die brigen Daten, NULL falls nicht bentigt
+ * @return Anzahl der nicht angenommenen Nachrichten, -1 im Fehlerfall
+ */
+int ublox_konfig(ublox* u, ubloxKonfig* nachrichten, int anzahl, ubxParser* weiter) {
+    char nachricht[UBX_NACHRICHT_MAX];
+    char puffer[256];
+    ubxParser parser;
+    ubloxKonfig* lauf[2] = {nachrichten, nachrichten + anzahl};
+    int offen = anzahl;
+
+    ubx_parser_init(&parser, NULL, ackZuordnen, lauf);
+
+    for(int i = 0; i < anzahl; i++) {
+        if(nachrichten[i].laenge > UBX_NACHRICHT_MAX - UBX_KOPF - 2) {
+            fprintf(stderr, "ublox_konfig: Nachricht %d ist zu lang!\n", i);
+            return -1;
+        }
+        nachrichten[i].ergebnis = UBLOX_OFFEN;
+    }
+
+    for(int versuch = 0; versuch < UBLOX_VERSUCHE && offen > 0; versuch++) {
+
+        // alle offenen Nachrichten hintereinander senden
+        for(int i = 0; i < anzahl; i++) {
+            if(nachrichten[i].ergebnis == UBLOX_ANGENOMMEN) {
+                continue;
+            }
+            nachrichten[i].ergebnis = UBLOX_OFFEN;
+
+            unsigned int laenge = ubx_bauen(nachricht, nachrichten[i].klasse, nachrichten[i].id,
+                                            nachrichten[i].nutzdaten, nachrichten[i].laenge);
+            if(ublox_schreiben(u, nachricht, laenge) == -1) {
+                fprintf(stderr, "ublox_konfig: Nachricht %d konnte nicht geschrieben werden!\n", i);
+                return -1;
+            }
+        }
+
+        // Antworten einsammeln, bis alle da sind oder die Zeit abgelaufen ist
+        for(int t = 0; t < UBLOX_ACK_TIMEOUT; t += UBLOX_ACK_INTERVALL) {
+            int n = ublox_drain(u, puffer, sizeof(puffer));
+            if(n < 0) {
+                return -1;
+            }
+            ublox_aufzeichnen(u, puffer, n);
+            ubx_verarbeiten(&parser, puffer, n);
+            if(weiter) {
+                ubx_verarbeiten(weiter, puffer, n);
+            }
+
+            offen = 0;
+            for(int i = 0; i < anzahl; i++) {
+                if(nachrichten[i].ergebnis == UBLOX_OFFEN) {
+                    offen++;
+                }
+            }
+            if(offen == 0) {
+                break;
+            }
+            delay(UBLOX_ACK_INTERVALL);
+        }
+
+        offen = 0;
+        for(int i = 0; i < anzahl; i++) {
+            if(nachrichten[i].ergebnis != UBLOX_ANGENOMMEN) {
+                offen++;
+            }
+        }
+    }
+
+    return offen;
+}
+
+/**
+ * @brief Empfnger fr ein Modul am Bus anlegen
+ *
+ * Die Rckrufe bekommen die mit #ublox_reihum gelesenen Daten. Soll der
+ * Datenstrom aufgezeichnet werden, danach ublox::aufzeichnen setzen, aber
+ * nur bei einem Empfnger, sonst vermischen sich die Datenstrme.
+ *
+ * @param u Empfnger
+ * @param adr I2C-Adresse des Moduls
+ * @param nmea Rckruf fr NMEA-Stze oder NULL
+ * @param ubx Rckruf fr UBX-Nachrichten oder NULL
+ * @param kontext wird an die Rckrufe bergeben
+ */
+void ublox_init(ublox* u, char adr, nmeaRueckruf nmea, ubxRueckruf ubx, void* kontext) {
+    memset(u, 0, sizeof(*u));
+    u->adr = adr;
+    ubx_parser_init(&u->parser, nmea, ubx, kontext);
+}
+
+/**
+ * @brief Mehrere Empfnger abwechselnd lesen
+ *
+ * In jeder Runde liest jeder Empfnger hchstens #UBLOX_PUFFER Bytes und
+ * gibt sie an seinen Parser. Es folgen weitere Runden, solange ein
+ * Empfnger einen vollen Puffer geliefert hat. So kann ein Modul mit
+ * viel Rckstand (z.B. nach einer AID-Abfrage) die anderen nicht
+ * aushungern, jedes kommt nach sptestens einem Zugriff pro anderem
+ * Empfnger wieder dran. Innerhalb einer Runde kommt zuerst der
+ * Empfnger dran, dessen letzter Zugriff am lngsten zurckliegt, damit
+ * nicht immer dasselbe Modul seine Daten am schnellsten bekommt.
+ *
+ * Der Bus wird nur fr jeweils einen Zugriff gesperrt (#bus_sperren),
+ * aufgezeichnet wird erst danach. Andere Threads kommen zwischen zwei
+ * Empfngern an den Adapter. Die Funktion selbst darf nur von einem
+ * Thread aus aufgerufen werden.
+ *
+ * @param empfaenger die zu lesenden Empfnger
+ * @param anzahl Anzahl der Empfnger
+ * @return Anzahl der insgesamt gelesenen Bytes, -1 falls jeder Zugriff fehlschlug
+ */
+int ublox_reihum(ublox** empfaenger, int anzahl) {
+    int gesamt = 0;
+    int zugriffe = 0;
+    int fehler = 0;
+    bool weiter = true;
+
+    while(weiter) {
+        // in dieser Runde bedient: bedient > runde
+        unsigned long runde = reihumZugriffe;
+        weiter = false;
+
+        for(int k = 0; k < anzahl; k++) {
+            ublox* u = NULL;
+            int n;
+
+            for(int i = 0; i < anzahl; i++) {
+                if(empfaenger[i]->bedient <= runde && (u == NULL || empfaenger[i]->bedient < u->bedient)) {
+                    u = empfaenger[i];
+                }
+            }
+            // derselbe Empfnger mehrfach in der Liste
+            if(u == NULL) {
+                break;
+            }
+            u->bedient = ++reihumZugriffe;
+
+            bus_sperren();
+            n = ublox_drain(u, u->puffer, sizeof(u->puffer));
+            bus_freigeben();
+
+            zugriffe++;
+            if(n < 0) {
+                fehler++;
+                continue;
+            }
+
+            ublox_aufzeichnen(u, u->puffer, n);
+            ubx_verarbeiten(&u->parser, u->puffer, n);
+            gesamt += n;
+            if(n == (int) sizeof(u->puffer)) {
+                weiter = true;
+            }
+        }
+    }
+
+    return (zugriffe > 0 && fehler == zugriffe) ? -1 : gesamt;
+}
@@ -7,6 +7,10 @@
  * zur Ansteuerung des u-blox NEO-7M GPS-Moduls inkludiert.
  * Auerdem wird die I2C-Adresse des Moduls hier festgelegt.
  *
+ * Die Funktionen mit Empfnger als Parameter (ublox_...) arbeiten auf
+ * einem beliebigen Modul am Bus, die brigen auf #ubloxStandard mit der
+ * Adresse #UBLOX_ADR.
+ *
  *
  * @authors Christopher Bchse und Jan Burmeister
  * @date Sommersemester 2017
@@ -17,11 +21,88 @@
 #ifndef UBLOX_H_
 #define UBLOX_H_
 
+#include <stdbool.h>
+
+#include "ubx.h"
+
 //! Die Adresse des u-blox NEO-7M Moduls betrgt normalerweise 0x42 (66).
 #define UBLOX_ADR 66  // 0x42
 
+//! Register mit der Anzahl bereitliegender Bytes (High-Byte, Low-Byte folgt in 0xFE)
+#define UBLOX_REG_ANZAHL 0xFD
+
+//! Bytes pro Schreibtransaktion, der I2C-Micro puffert sie in der Wire-Library (32 Bytes)
+#define UBLOX_SCHREIBEN_MAX 32
+
+/**
+ * @defgroup UbloxKonfig Konfiguration mit Besttigung
+ * @{
+ * #configUblox sendet mehrere CFG-Nachrichten hintereinander und ordnet
+ * die ACK-ACK/ACK-NAK-Antworten aus dem Datenstrom zu. Nur Nachrichten
+ * ohne Besttigung werden wiederholt.
+ */
+#define UBLOX_ACK_TIMEOUT 1000   //!< Wartezeit auf die Antworten eines Durchgangs in ms
+#define UBLOX_ACK_INTERVALL 20   //!< Abstand der Abfragen beim Warten in ms
+#define UBLOX_VERSUCHE 3         //!< Durchgnge, bevor eine Nachricht aufgegeben wird
+
+#define UBLOX_OFFEN 0            //!< noch keine Antwort
+#define UBLOX_ANGENOMMEN 1       //!< ACK-ACK empfangen
+#define UBLOX_ABGELEHNT 2        //!< ACK-NAK empfangen
+
+/**
+ * @brief Eine zu sendende CFG-Nachricht und ihr Ergebnis
+ */
+typedef struct ubloxKonfig {
+    unsigned char klasse;      //!< Nachrichtenklasse, meist #UBX_CFG
+    unsigned char id;          //!< Nachrichten-ID
+    const char* nutzdaten;     //!< Nutzdaten
+    unsigned int laenge;       //!< Lnge der Nutzdaten
+    int ergebnis;              //!< #UBLOX_OFFEN, #UBLOX_ANGENOMMEN oder #UBLOX_ABGELEHNT
+} ubloxKonfig;
+/** @} */
+
+//! Bytes, die #ublox_reihum pro Runde hchstens von einem Empfnger liest
+#define UBLOX_PUFFER 256
+
+/**
+ * @brief Ein u-blox-Empfnger am Bus
+ *
+ * Mehrere Module am selben Adapter brauchen verschiedene Adressen. Die
+ * Adresse wird mit CFG-PRT (Feld mode des DDC-Ports) eingestellt und mit
+ * CFG-CFG im Modul gespeichert, ab Werk haben alle #UBLOX_ADR.
+ *
+ * Der I2C-Micro fragt bis zu #UBLOX_MODULE Module reihum im Hintergrund
+ * ab, in der Reihenfolge, in der sie zuerst gelesen werden. Weitere (und
+ * alle ohne #FAEHIG_UBLOX_MEHR auer dem ersten) werden direkt ber die
+ * Register gelesen, was nur mit dem USB-ITS zuverlssig geht.
+ */
+typedef struct ublox {
+    char adr;                  //!< I2C-Adresse
+    ubxParser parser;          //!< zerlegt die mit #ublox_reihum gelesenen Daten
+    char puffer[UBLOX_PUFFER];
+    bool aufzeichnen;          //!< gelesene Daten an die laufende Aufzeichnung anhngen
+    unsigned long bedient;     //!< laufende Nummer des letzten Zugriffs durch #ublox_reihum
+    unsigned long bytes;       //!< insgesamt gelesene Bytes
+    unsigned long fehler;      //!< fehlgeschlagene Zugriffe
+} ublox;
+
+extern ublox ubloxStandard;
+
 // Funktionsprototypen
 extern int randomReadUblox(char adr, char* b, unsigned int length);
 extern int writeUblox(char* b, int length);
+extern int startPollUblox(void);
+extern int stopPollUblox(void);
+extern int fetchUblox(char* buffer, unsigned int max);
+extern int drainUblox(char* buffer, unsigned int max);
+extern int binaryModeUblox(bool binaer);
+extern int configUblox(ubloxKonfig* nachrichten, int anzahl, ubxParser* weiter);
+extern void ublox_init(ublox* u, char adr, nmeaRueckruf nmea, ubxRueckruf ubx, void* kontext);
+extern int ublox_schreiben(ublox* u, char* b, int length);
+extern int ublox_drain(ublox* u, char* buffer, unsigned int max);
+extern void ublox_aufzeichnen(const ublox* u, const char* daten, int anzahl);
+extern int ublox_binaer(ublox* u, bool binaer);
+extern int ublox_konfig(ublox* u, ubloxKonfig* nachrichten, int anzahl, ubxParser* weiter);
+extern int ublox_reihum(ublox** empfaenger, int anzahl);
 
 #endif // UBLOX_H_
@@ -0,0 +1,485 @@
+/**
+ * @file ubx.c
+ *
+ * @brief Parser für den Datenstrom des u-blox NEO-7M GPS-Moduls
+ *
+ * Der Parser ist ein Automat, der Byte für Byte weiterläuft. Solange eine
+ * Nachricht vollständig im übergebenen Stück liegt, zeigen die an die
+ * Rückruffunktionen übergebenen Zeiger direkt in dieses Stück. Nur der
+ * angefangene Rest am Ende eines Stücks wird in den Puffer des Parsers
+ * kopiert.
+ *
+ * Nach einer falschen Prüfsumme, einem ungültigen Zeichen oder einer zu
+ * großen Längenangabe wird ab dem zweiten Byte der verworfenen Nachricht
+ * neu gesucht. Eine echte Nachricht, die von einem falschen Anfang
+ * verschluckt wurde, geht so nicht verloren.
+ *
+ * Für das Wiedereinspielen großer Aufzeichnungen (siehe gpsreplay.c) sind
+ * die häufigen Fälle auf Durchsatz ausgelegt: Die Suche nach dem Anfang
+ * einer Nachricht prüft acht Bytes auf einmal, Nutzdaten und NMEA-Text
+ * werden in einer engen Schleife statt Byte für Byte durch den Automaten
+ * geschickt.
+ *
+ * @see https://www.u-blox.com/sites/default/files/products/documents/u-blox7-V14_ReceiverDescrProtSpec_%28GPS.G7-SW-12001%29_Public.pdf
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "ubx.h"
+
+// Zustände des Automaten
+#define SUCHEN 0
+#define NMEA_SATZ 1
+#define NMEA_SUMME1 2
+#define NMEA_SUMME2 3
+#define UBX_SYNC 4
+#define UBX_KLASSE 5
+#define UBX_ID 6
+#define UBX_LAENGE1 7
+#define UBX_LAENGE2 8
+#define UBX_NUTZDATEN 9
+#define UBX_CK_A 10
+#define UBX_CK_B 11
+
+// Ergebnisse von schritt()
+#define WEITER 0
+#define FERTIG 1
+#define FEHLER -1
+
+/**
+ * @brief Parser initialisieren
+ *
+ * @param p Parser
+ * @param nmea Rückruf für NMEA-Sätze, NULL falls nicht benötigt
+ * @param ubx Rückruf für UBX-Nachrichten, NULL falls nicht benötigt
+ * @param kontext wird unverändert an die Rückrufe übergeben
+ */
+void ubx_parser_init(ubxParser* p, nmeaRueckruf nmea, ubxRueckruf ubx, void* kontext) {
+    memset(p, 0, sizeof(*p));
+    p->zustand = SUCHEN;
+    p->nmea = nmea;
+    p->ubx = ubx;
+    p->kontext = kontext;
+}
+
+/**
+ * @brief Interne Funktion, Wert einer Hexadezimalziffer
+ * @return 0-15 oder -1, falls keine Hexadezimalziffer
+ */
+int hexziffer(unsigned char c) {
+    if(c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if(c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if(c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @brief Interne Funktion, UBX-Prüfsumme um ein Byte weiterrechnen
+ */
+void ubx_summe(ubxParser* p, unsigned char c) {
+    p->ckA += c;
+    p->ckB += p->ckA;
+}
+
+/**
+ * @brief Interne Funktion, Anfang der nächsten Nachricht suchen
+ *
+ * Vergleicht jeweils acht Bytes gleichzeitig mit '$' und #UBX_SYNC1
+ * (SWAR: ein Byte ist genau dann gleich, wenn es in w ^ muster null ist).
+ *
+ * @return Index des ersten '$' oder #UBX_SYNC1, laenge falls keines
+ */
+unsigned int synchronsuche(const char* daten, unsigned int laenge) {
+    const uint64_t eins = 0x0101010101010101ULL;
+    const uint64_t hoch = 0x8080808080808080ULL;
+    const uint64_t dollar = eins * '$';
+    const uint64_t sync = eins * UBX_SYNC1;
+    unsigned int i = 0;
+
+    for(; i + 8 <= laenge; i += 8) {
+        uint64_t w;
+        uint64_t a;
+        uint64_t b;
+
+        memcpy(&w, daten + i, 8);
+        a = w ^ dollar;
+        b = w ^ sync;
+        if((((a - eins) & ~a) | ((b - eins) & ~b)) & hoch) {
+            break;
+        }
+    }
+
+    for(; i < laenge; i++) {
+        if(daten[i] == '$' || (unsigned char) daten[i] == UBX_SYNC1) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/**
+ * @brief Interne Funktion, Nutzdaten bzw. NMEA-Text am Stück verarbeiten
+ *
+ * Verarbeitet Bytes, solange der Zustand sich dabei nicht ändern würde.
+ * Das Byte, das den Zustand ändert ('*', ungültiges Zeichen, letztes
+ * Nutzdatenbyte), bleibt für #schritt liegen.
+ *
+ * @return Anzahl der verarbeiteten Bytes
+ */
+unsigned int blockweise(ubxParser* p, const char* daten, unsigned int laenge) {
+    unsigned int n = 0;
+
+    if(p->zustand == UBX_NUTZDATEN) {
+        unsigned char ckA = p->ckA;
+        unsigned char ckB = p->ckB;
+        unsigned int rest = UBX_KOPF + p->laenge - p->pos;
+
+        // das letzte Byte schaltet den Zustand weiter
+        if(rest > 0) {
+            rest--;
+        }
+        if(laenge > rest) {
+            laenge = rest;
+        }
+        for(; n < laenge; n++) {
+            ckA += (unsigned char) daten[n];
+            ckB += ckA;
+        }
+        p->ckA = ckA;
+        p->ckB = ckB;
+    } else if(p->zustand == NMEA_SATZ) {
+        unsigned char summe = p->summe;
+        unsigned int rest = p->pos < NMEA_SATZ_MAX ? NMEA_SATZ_MAX - p->pos : 0;
+
+        if(laenge > rest) {
+            laenge = rest;
+        }
+        for(; n < laenge; n++) {
+            unsigned char c = (unsigned char) daten[n];
+            if(c < 0x20 || c > 0x7E || c == '$' || c == '*') {
+                break;
+            }
+            summe ^= c;
+        }
+        p->summe = summe;
+    }
+
+    return n;
+}
+
+/**
+ * @brief Interne Funktion, ein Byte einer angefangenen Nachricht verarbeiten
+ * @return #WEITER, #FERTIG oder #FEHLER
+ */
+int schritt(ubxParser* p, unsigned char c) {
+    int wert;
+
+    switch(p->zustand) {
+    case NMEA_SATZ:
+        if(c == '*') {
+            p->zustand = NMEA_SUMME1;
+        } else if(c < 0x20 || c > 0x7E || c == '$' || p->pos > NMEA_SATZ_MAX) {
+            p->verworfen++;
+            return FEHLER;
+        } else {
+            p->summe ^= c;
+        }
+        return WEITER;
+
+    case NMEA_SUMME1:
+    case NMEA_SUMME2:
+        wert = hexziffer(c);
+        if(wert < 0) {
+            p->verworfen++;
+            return FEHLER;
+        }
+        if(p->zustand == NMEA_SUMME1) {
+            p->erwartet = wert << 4;
+            p->zustand = NMEA_SUMME2;
+            return WEITER;
+        }
+        if((p->erwartet | wert) != p->summe) {
+            p->pruefsummen++;
+            return FEHLER;
+        }
+        return FERTIG;
+
+    case UBX_SYNC:
+        if(c != UBX_SYNC2) {
+            p->verworfen++;
+            return FEHLER;
+        }
+        p->ckA = 0;
+        p->ckB = 0;
+        p->zustand = UBX_KLASSE;
+        return WEITER;
+
+    case UBX_KLASSE:
+        ubx_summe(p, c);
+        p->zustand = UBX_ID;
+        return WEITER;
+
+    case UBX_ID:
+        ubx_summe(p, c);
+        p->zustand = UBX_LAENGE1;
+        return WEITER;
+
+    case UBX_LAENGE1:
+        ubx_summe(p, c);
+        p->laenge = c;
+        p->zustand = UBX_LAENGE2;
+        return WEITER;
+
+    case UBX_LAENGE2:
+        ubx_summe(p, c);
+        p->laenge |= (unsigned int) c << 8;
+        if(p->laenge > UBX_NACHRICHT_MAX - UBX_KOPF - 2) {
+            p->verworfen++;
+            return FEHLER;
+        }
+        p->zustand = (p->laenge > 0) ? UBX_NUTZDATEN : UBX_CK_A;
+        return WEITER;
+
+    case UBX_NUTZDATEN:
+        ubx_summe(p, c);
+        if(p->pos == UBX_KOPF + p->laenge) {
+            p->zustand = UBX_CK_A;
+        }
+        return WEITER;
+
+    case UBX_CK_A:
+        if(c != p->ckA) {
+            p->pruefsummen++;
+            return FEHLER;
+        }
+        p->zustand = UBX_CK_B;
+        return WEITER;
+
+    case UBX_CK_B:
+        if(c != p->ckB) {
+            p->pruefsummen++;
+            return FEHLER;
+        }
+        return FERTIG;
+    }
+
+    return FEHLER;
+}
+
+/**
+ * @brief Interne Funktion, eine vollständige Nachricht übergeben
+ */
+void ausliefern(ubxParser* p) {
+    const char* nachricht = p->anfang ? p->anfang : p->puffer;
+
+    if(nachricht[0] == '$') {
+        p->nmeaSaetze++;
+        if(p->nmea) {
+            p->nmea(nachricht, p->pos, p->kontext);
+        }
+    } else {
+        p->ubxNachrichten++;
+        if(p->ubx) {
+            p->ubx((unsigned char) nachricht[2], (unsigned char) nachricht[3],
+                   nachricht + UBX_KOPF, p->laenge, p->kontext);
+        }
+    }
+}
+
+/**
+ * @brief Ein Stück des Datenstroms verarbeiten
+ *
+ * Die Stücke dürfen beliebig groß sein und an beliebigen Stellen
+ * getrennt werden. Die Rückrufe werden aus dieser Funktion heraus
+ * aufgerufen, dürfen sie für denselben Parser aber nicht selbst aufrufen.
+ * 0xFF, das das Modul bei leerem Puffer liefert, wird überlesen.
+ *
+ * @param p Parser
+ * @param daten Daten aus Register 0xFF
+ * @param laenge Anzahl der Bytes
+ */
+void ubx_verarbeiten(ubxParser* p, const char* daten, unsigned int laenge) {
+    unsigned int i = 0;
+
+    while(i < laenge) {
+        unsigned char c;
+        unsigned int n;
+
+        if(p->zustand == SUCHEN) {
+            i += synchronsuche(daten + i, laenge - i);
+            if(i == laenge) {
+                break;
+            }
+            c = (unsigned char) daten[i];
+            p->zustand = (c == '$') ? NMEA_SATZ : UBX_SYNC;
+            p->anfang = daten + i;
+            p->pos = 1;
+            p->summe = 0;
+            i++;
+            continue;
+        }
+
+        n = blockweise(p, daten + i, laenge - i);
+        if(n > 0) {
+            if(p->anfang == NULL) {
+                memcpy(p->puffer + p->pos, daten + i, n);
+            }
+            p->pos += n;
+            i += n;
+            continue;
+        }
+
+        c = (unsigned char) daten[i];
+
+        // angefangene Nachricht aus einem früheren Stück liegt im Puffer
+        if(p->anfang == NULL) {
+            p->puffer[p->pos] = c;
+        }
+        p->pos++;
+        i++;
+
+        switch(schritt(p, c)) {
+        case FERTIG:
+            ausliefern(p);
+            p->zustand = SUCHEN;
+            break;
+
+        case FEHLER:
+            p->zustand = SUCHEN;
+            if(p->anfang != NULL) {
+                // liegt im aktuellen Stück: dort ab dem zweiten Byte neu suchen
+                i = (p->anfang - daten) + 1;
+            } else {
+                // liegt im Puffer: Kopie davon noch einmal durchlaufen lassen
+                char kopie[UBX_NACHRICHT_MAX];
+                unsigned int anzahl = p->pos - 1;
+
+                memcpy(kopie, p->puffer + 1, anzahl);
+                ubx_verarbeiten(p, kopie, anzahl);
+            }
+            break;
+        }
+    }
+
+    // angefangene Nachricht für das nächste Stück aufheben
+    if(p->zustand != SUCHEN && p->anfang != NULL) {
+        memcpy(p->puffer, p->anfang, p->pos);
+        p->anfang = NULL;
+    }
+}
+
+/**
+ * @brief Prüfen, ob eine angefangene Nachricht im Parser liegt
+ *
+ * Zum Beispiel, um beim abschnittsweisen Verarbeiten eines Datenstroms
+ * eine über die Abschnittsgrenze reichende Nachricht noch zu Ende zu
+ * lesen.
+ */
+bool ubx_in_nachricht(const ubxParser* p) {
+    return p->zustand != SUCHEN;
+}
+
+/**
+ * @brief UBX-Nachricht mit Kopf und Prüfsumme zusammensetzen
+ *
+ * @param ziel Puffer für die Nachricht, mindestens laenge + 8 Bytes
+ * @param klasse Nachrichtenklasse
+ * @param id Nachrichten-ID
+ * @param nutzdaten Nutzdaten, darf bei laenge 0 NULL sein
+ * @param laenge Länge der Nutzdaten
+ * @return Länge der ganzen Nachricht
+ */
+unsigned int ubx_bauen(char* ziel, unsigned char klasse, unsigned char id,
+                       const char* nutzdaten, unsigned int laenge) {
+    unsigned char ckA = 0;
+    unsigned char ckB = 0;
+
+    ziel[0] = (char) UBX_SYNC1;
+    ziel[1] = (char) UBX_SYNC2;
+    ziel[2] = (char) klasse;
+    ziel[3] = (char) id;
+    ziel[4] = (char) (laenge & 0xFF);
+    ziel[5] = (char) (laenge >> 8);
+    if(laenge > 0) {
+        memcpy(ziel + UBX_KOPF, nutzdaten, laenge);
+    }
+
+    for(unsigned int i = 2; i < UBX_KOPF + laenge; i++) {
+        ckA += (unsigned char) ziel[i];
+        ckB += ckA;
+    }
+    ziel[UBX_KOPF + laenge] = (char) ckA;
+    ziel[UBX_KOPF + laenge + 1] = (char) ckB;
+
+    return UBX_KOPF + laenge + 2;
+}
+
+/**
+ * @brief Interne Funktion, vorzeichenlose Little-Endian-Zahl lesen
+ */
+unsigned long ubx_u(const char* d, int bytes) {
+    unsigned long wert = 0;
+
+    for(int i = bytes - 1; i >= 0; i--) {
+        wert = (wert << 8) | (unsigned char) d[i];
+    }
+    return wert;
+}
+
+/**
+ * @brief Interne Funktion, vorzeichenbehaftete 32-Bit-Zahl lesen
+ */
+long ubx_i32(const char* d) {
+    unsigned long wert = ubx_u(d, 4);
+
+    return (wert & 0x80000000UL) ? -(long) (0xFFFFFFFFUL - wert) - 1 : (long) wert;
+}
+
+/**
+ * @brief Nutzdaten einer NAV-PVT-Nachricht dekodieren
+ *
+ * @param nutzdaten Nutzdaten, wie sie der UBX-Rückruf liefert
+ * @param laenge Länge der Nutzdaten
+ * @param fix Ergebnis
+ * @return false, falls die Nachricht zu kurz ist
+ */
+bool ubx_nav_pvt(const char* nutzdaten, unsigned int laenge, ubxFix* fix) {
+    const char* d = nutzdaten;
+
+    if(laenge < UBX_NAV_PVT_LAENGE) {
+        return false;
+    }
+
+    fix->iTOW = ubx_u(d, 4);
+    fix->jahr = (unsigned short) ubx_u(d + 4, 2);
+    fix->monat = (unsigned char) d[6];
+    fix->tag = (unsigned char) d[7];
+    fix->stunde = (unsigned char) d[8];
+    fix->minute = (unsigned char) d[9];
+    fix->sekunde = (unsigned char) d[10];
+    fix->datumGueltig = d[11] & 0x01;
+    fix->zeitGueltig = (d[11] & 0x02) != 0;
+    fix->zeitGenauigkeit = ubx_u(d + 12, 4);
+    fix->nano = ubx_i32(d + 16);
+    fix->fixTyp = (unsigned char) d[20];
+    fix->fixOk = d[21] & 0x01;
+    fix->satelliten = (unsigned char) d[23];
+    fix->laengengrad = ubx_i32(d + 24) * 1e-7;
+    fix->breitengrad = ubx_i32(d + 28) * 1e-7;
+    fix->hoeheEllipsoid = ubx_i32(d + 32) * 1e-3;
+    fix->hoehe = ubx_i32(d + 36) * 1e-3;
+    fix->hGenauigkeit = ubx_u(d + 40, 4) * 1e-3;
+    fix->vGenauigkeit = ubx_u(d + 44, 4) * 1e-3;
+    fix->geschwindigkeit = ubx_i32(d + 60) * 1e-3;
+    fix->kurs = ubx_i32(d + 64) * 1e-5;
+
+    return true;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file ubx.h
+ *
+ * @brief Parser für den Datenstrom des u-blox NEO-7M GPS-Moduls
+ *
+ * Der Datenstrom aus Register 0xFF enthält NMEA-Sätze und UBX-Nachrichten
+ * gemischt. Der Parser nimmt beliebig große Stücke dieses Stroms entgegen,
+ * prüft die Prüfsummen und übergibt vollständige Nachrichten an
+ * Rückruffunktionen. Er kommt mit einem festen Puffer aus und kopiert eine
+ * Nachricht nur dann, wenn sie über die Grenze zweier Stücke geht.
+ *
+ * @see https://www.u-blox.com/sites/default/files/products/documents/u-blox7-V14_ReceiverDescrProtSpec_%28GPS.G7-SW-12001%29_Public.pdf
+ */
+
+#ifndef UBX_H_
+#define UBX_H_
+
+#include <stdbool.h>
+
+#define UBX_SYNC1 0xB5   /*!< erstes Synchronisationszeichen einer UBX-Nachricht */
+#define UBX_SYNC2 0x62   /*!< zweites Synchronisationszeichen einer UBX-Nachricht */
+#define UBX_KOPF 6       /*!< Sync, Klasse, ID und Länge */
+
+/**
+ * @defgroup UbxNachrichten Klassen und IDs der verwendeten UBX-Nachrichten
+ * @{
+ */
+#define UBX_NAV 0x01            /*!< Klasse NAV: Navigationsergebnisse */
+#define UBX_NAV_PVT 0x07        /*!< NAV-PVT: Position, Geschwindigkeit und Zeit */
+#define UBX_NAV_PVT_LAENGE 84   /*!< Nutzdatenlänge von NAV-PVT (u-blox 7, neuere senden 92) */
+#define UBX_CFG 0x06            /*!< Klasse CFG: Konfiguration */
+#define UBX_CFG_PRT 0x00        /*!< CFG-PRT: Schnittstelle einstellen */
+#define UBX_CFG_MSG 0x01        /*!< CFG-MSG: Ausgaberate einer Nachricht */
+#define UBX_ACK 0x05            /*!< Klasse ACK: Antwort auf CFG-Nachrichten */
+#define UBX_ACK_NAK 0x00        /*!< ACK-NAK: Nachricht abgelehnt */
+#define UBX_ACK_ACK 0x01        /*!< ACK-ACK: Nachricht angenommen */
+#define UBX_AID 0x0B            /*!< Klasse AID: Hilfsdaten für einen schnellen Start */
+#define UBX_AID_INI 0x01        /*!< AID-INI: Position, Zeit und Uhrendrift */
+#define UBX_AID_INI_LAENGE 48
+#define UBX_AID_ALM 0x30        /*!< AID-ALM: Almanach eines Satelliten */
+#define UBX_AID_ALM_LAENGE 40   /*!< mit Almanach, ohne sind es 8 Bytes */
+#define UBX_AID_EPH 0x31        /*!< AID-EPH: Ephemeriden eines Satelliten */
+#define UBX_AID_EPH_LAENGE 104  /*!< mit Ephemeriden, ohne sind es 8 Bytes */
+/** @} */
+
+/**
+ * Größte UBX-Nachricht, die angenommen wird, inklusive Kopf und
+ * Prüfsumme. Längere Nachrichten werden verworfen, damit eine
+ * verfälschte Längenangabe den Parser nicht lange blockiert.
+ */
+#define UBX_NACHRICHT_MAX 1024
+
+/**
+ * Größte NMEA-Satzlänge ohne CR/LF. Der Standard erlaubt 82 Zeichen,
+ * die PUBX-Sätze von u-blox sind etwas länger.
+ */
+#define NMEA_SATZ_MAX 128
+
+/**
+ * @brief Rückruf für einen gültigen NMEA-Satz
+ * @param satz Satz von '$' bis einschließlich der Prüfsumme, ohne CR/LF
+ *     und nicht nullterminiert; nur während des Aufrufs gültig
+ * @param laenge Länge des Satzes
+ * @param kontext bei #ubx_parser_init übergebener Zeiger
+ */
+typedef void (*nmeaRueckruf)(const char* satz, unsigned int laenge, void* kontext);
+
+/**
+ * @brief Rückruf für eine gültige UBX-Nachricht
+ * @param klasse Nachrichtenklasse
+ * @param id Nachrichten-ID
+ * @param nutzdaten Nutzdaten; nur während des Aufrufs gültig
+ * @param laenge Länge der Nutzdaten
+ * @param kontext bei #ubx_parser_init übergebener Zeiger
+ */
+typedef void (*ubxRueckruf)(unsigned char klasse, unsigned char id,
+                            const char* nutzdaten, unsigned int laenge, void* kontext);
+
+/**
+ * @brief Zustand eines Parsers
+ *
+ * Die Felder sind bis auf die Zähler intern.
+ */
+typedef struct ubxParser {
+    int zustand;               /*!< Zustand des Automaten */
+    unsigned int pos;          /*!< Bytes der aktuellen Nachricht */
+    unsigned int laenge;       /*!< erwartete UBX-Nutzdatenlänge */
+    unsigned char ckA;         /*!< UBX-Prüfsumme (Fletcher) */
+    unsigned char ckB;
+    unsigned char summe;       /*!< NMEA-Prüfsumme (XOR) */
+    unsigned char erwartet;    /*!< empfangene NMEA-Prüfsumme */
+    const char* anfang;        /*!< Nachricht im aktuellen Stück, NULL: im Puffer */
+    char puffer[UBX_NACHRICHT_MAX];
+
+    nmeaRueckruf nmea;
+    ubxRueckruf ubx;
+    void* kontext;
+
+    unsigned long nmeaSaetze;      /*!< gültige NMEA-Sätze */
+    unsigned long ubxNachrichten;  /*!< gültige UBX-Nachrichten */
+    unsigned long pruefsummen;     /*!< Nachrichten mit falscher Prüfsumme */
+    unsigned long verworfen;       /*!< abgebrochene Nachrichten (zu lang, ungültige Zeichen) */
+} ubxParser;
+
+/**
+ * @brief Aus NAV-PVT dekodierte Lösung
+ */
+typedef struct ubxFix {
+    unsigned long iTOW;        /*!< GPS-Zeit der Epoche in der Woche in ms */
+    unsigned short jahr;       /*!< UTC-Datum und -Zeit */
+    unsigned char monat;
+    unsigned char tag;
+    unsigned char stunde;
+    unsigned char minute;
+    unsigned char sekunde;
+    long nano;                 /*!< Bruchteil der Sekunde in ns, auch negativ */
+    bool datumGueltig;
+    bool zeitGueltig;
+    unsigned long zeitGenauigkeit; /*!< geschätzte Genauigkeit der Zeit in ns */
+    unsigned char fixTyp;      /*!< 0: kein Fix, 2: 2D, 3: 3D, ... */
+    bool fixOk;                /*!< gültiger Fix (gnssFixOK) */
+    unsigned char satelliten;  /*!< für die Lösung verwendete Satelliten */
+    double laengengrad;        /*!< in Grad */
+    double breitengrad;        /*!< in Grad */
+    double hoehe;              /*!< über dem Meeresspiegel in m */
+    double hoeheEllipsoid;     /*!< über dem Ellipsoid in m */
+    double hGenauigkeit;       /*!< geschätzte horizontale Genauigkeit in m */
+    double vGenauigkeit;       /*!< geschätzte vertikale Genauigkeit in m */
+    double geschwindigkeit;    /*!< über Grund in m/s */
+    double kurs;               /*!< Bewegungsrichtung in Grad */
+} ubxFix;
+
+// Funktionsprototypen
+extern void ubx_parser_init(ubxParser* p, nmeaRueckruf nmea, ubxRueckruf ubx, void* kontext);
+extern void ubx_verarbeiten(ubxParser* p, const char* daten, unsigned int laenge);
+extern bool ubx_in_nachricht(const ubxParser* p);
+extern unsigned int ubx_bauen(char* ziel, unsigned char klasse, unsigned char id,
+                              const char* nutzdaten, unsigned int laenge);
+extern bool ubx_nav_pvt(const char* nutzdaten, unsigned int laenge, ubxFix* fix);
+
+#endif // UBX_H_